@@ -0,0 +1,368 @@
+// DGen/SDL headless benchmark runner
+// Drives md::one_frame() without any platform layer so that emulation
+// throughput can be measured on a regular host.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+
+#define IS_MAIN_CPP
+#include "system.h"
+#include "md.h"
+#include "pd.h"
+#include "pd-defs.h"
+#include "rc.h"
+#include "rc-vars.h"
+
+FILE *debug_log = NULL;
+
+// This is the only pd_ function the core may call.
+unsigned long pd_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long)((tv.tv_sec * 1000000) + tv.tv_usec);
+}
+
+// Input script entry: from frame "frame" onward, pads are set to "pad".
+struct bench_input {
+	unsigned long frame;
+	int pad[2];
+};
+
+static struct bench_input *input;
+static size_t input_len;
+
+// FNV-1a, used to compare output between builds.
+static uint32_t checksum(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	while (len--) {
+		sum ^= *(p++);
+		sum *= 16777619;
+	}
+	return sum;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] romname\n"
+		"  -f frames   Number of measured frames (default 1000).\n"
+		"  -w frames   Number of warm-up frames, not measured"
+		" (default 60).\n"
+		"  -V          Disable video (render nothing, bm = NULL).\n"
+		"  -S          Disable sound (sndi = NULL).\n"
+		"  -b bpp      Bits per pixel of the off-screen bitmap"
+		" (8, 15, 16, 24, 32;\n"
+		"              default 16).\n"
+		"  -R region   Region (J, X, U or E), otherwise guessed from"
+		" the ROM.\n"
+		"  -P          Force PAL (50Hz).\n"
+		"  -N          Force NTSC (60Hz).\n"
+		"  -r rate     Sound rate (default 44100).\n"
+		"  -n          Run sound chips at their own rate and resample"
+		" their output.\n"
+		"  -c          Print checksums of video and sound output.\n"
+		"  -T threads  Draw in separate threads, each one a band of"
+		" lines (0 for\n"
+		"              one per CPU). Video output is one frame late.\n"
+		"  -i file     Input script, one \"frame pad1 [pad2]\" entry per"
+		" line.\n"
+		"              Pad values are raw active-low masks"
+		" (see MD_*_MASK),\n"
+		"              e.g. \"120 0xf1f3f\" holds START from frame"
+		" 120.\n",
+		name);
+}
+
+// Load an input script. Lines starting with '#' are comments, entries must
+// be sorted by frame number.
+static int input_load(const char *name)
+{
+	FILE *file;
+	char line[256];
+	unsigned int num = 0;
+
+	if ((file = fopen(name, "r")) == NULL) {
+		perror(name);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		struct bench_input *tmp;
+		struct bench_input in;
+		char *p = line;
+		char *end;
+
+		++num;
+		while (isspace((unsigned char)*p))
+			++p;
+		if ((*p == '\0') || (*p == '#'))
+			continue;
+		in.frame = strtoul(p, &end, 0);
+		if (end == p)
+			goto bad;
+		p = end;
+		in.pad[0] = strtol(p, &end, 0);
+		if (end == p)
+			goto bad;
+		p = end;
+		in.pad[1] = strtol(p, &end, 0);
+		if (end == p)
+			in.pad[1] = MD_PAD_UNTOUCHED;
+		if ((input_len) && (in.frame < input[(input_len - 1)].frame))
+			goto bad;
+		tmp = (struct bench_input *)
+			realloc(input, (sizeof(*input) * (input_len + 1)));
+		if (tmp == NULL) {
+			perror("realloc");
+			fclose(file);
+			return -1;
+		}
+		input = tmp;
+		input[(input_len++)] = in;
+		continue;
+	bad:
+		fprintf(stderr, "%s:%u: invalid entry\n", name, num);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long frames = 1000;
+	unsigned long warmup = 60;
+	bool video = true;
+	bool sound = true;
+	int bpp = 16;
+	char region = 0;
+	int force_pal = -1;
+	const char *script = NULL;
+	bool check = false;
+	uint32_t video_sum = 2166136261u;
+	uint32_t sound_sum = 2166136261u;
+	md *megad;
+	struct bmap bm;
+	struct sndinfo si;
+	unsigned long *usecs;
+	unsigned long total;
+	unsigned long i;
+	size_t next = 0;
+	unsigned long long sum = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "f:w:VSb:R:PNr:ncT:i:h")) != -1) {
+		switch (c) {
+		case 'f':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'V':
+			video = false;
+			break;
+		case 'S':
+			sound = false;
+			break;
+		case 'b':
+			bpp = atoi(optarg);
+			break;
+		case 'R':
+			region = (toupper((unsigned char)optarg[0]));
+			if (strchr("JXUE", region) == NULL) {
+				fprintf(stderr, "%s: invalid region\n", argv[0]);
+				return 2;
+			}
+			break;
+		case 'P':
+			force_pal = 1;
+			break;
+		case 'N':
+			force_pal = 0;
+			break;
+		case 'r':
+			dgen_soundrate = strtol(optarg, NULL, 0);
+			if (dgen_soundrate <= 0) {
+				fprintf(stderr, "%s: invalid sound rate\n",
+					argv[0]);
+				return 2;
+			}
+			break;
+		case 'n':
+			dgen_sound_native = 1;
+			break;
+		case 'c':
+			check = true;
+			break;
+		case 'T':
+			dgen_screen_thread = 1;
+			dgen_screen_bands = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			script = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if ((optind != (argc - 1)) || (frames == 0)) {
+		usage(argv[0]);
+		return 2;
+	}
+	switch (bpp) {
+	case 8:
+	case 15:
+	case 16:
+	case 24:
+	case 32:
+		break;
+	default:
+		fprintf(stderr, "%s: unsupported depth %d\n", argv[0], bpp);
+		return 2;
+	}
+	if ((script != NULL) && (input_load(script)))
+		return 1;
+	if (region) {
+		int pal, hz;
+
+		md::region_info(region, &pal, &hz, 0, 0, 0);
+		dgen_region = region;
+		dgen_pal = pal;
+		dgen_hz = hz;
+	}
+	if (force_pal != -1) {
+		dgen_pal = force_pal;
+		dgen_hz = (force_pal ? PAL_HZ : NTSC_HZ);
+	}
+	dgen_sound = sound;
+	megad = new md(dgen_pal, dgen_region);
+	if ((megad == NULL) || (!megad->okay())) {
+		fprintf(stderr, "%s: Mega Drive initialization failed.\n",
+			argv[0]);
+		return 1;
+	}
+	if (megad->load(argv[optind])) {
+		delete megad;
+		return 1;
+	}
+	megad->pad[0] = MD_PAD_UNTOUCHED;
+	megad->pad[1] = MD_PAD_UNTOUCHED;
+	megad->reset();
+	// Same automatic region handling as dgen().
+	if (!dgen_region) {
+		uint8_t r = megad->region_guess();
+		int hz;
+		int pal;
+
+		md::region_info(r, &pal, &hz, 0, 0, 0);
+		if (force_pal != -1) {
+			pal = dgen_pal;
+			hz = dgen_hz;
+		}
+		if ((hz != dgen_hz) || (pal != dgen_pal) ||
+		    (r != megad->region)) {
+			megad->region = r;
+			dgen_hz = hz;
+			dgen_pal = pal;
+			megad->pal = pal;
+			megad->init_pal();
+			megad->init_sound();
+		}
+	}
+	// Off-screen bitmap, same geometry as pd.h requires.
+	memset(&bm, 0, sizeof(bm));
+	bm.w = 336;
+	bm.h = (dgen_pal ? 256 : 240);
+	bm.bpp = bpp;
+	bm.pitch = (bm.w * ((bpp + 7) / 8));
+	bm.data = (unsigned char *)calloc(bm.h, bm.pitch);
+	// One frame worth of interleaved stereo samples.
+	si.len = (dgen_soundrate / dgen_hz);
+	si.lr = (int16_t *)calloc(si.len, (sizeof(si.lr[0]) * 2));
+	usecs = (unsigned long *)calloc(frames, sizeof(*usecs));
+	if ((bm.data == NULL) || (si.lr == NULL) || (usecs == NULL)) {
+		perror("calloc");
+		free(bm.data);
+		free(si.lr);
+		free(usecs);
+		delete megad;
+		return 1;
+	}
+	printf("%s: %lu+%lu frames, %s %dHz, video %s (%d bpp),"
+	       " sound %s (%ld Hz)\n",
+	       megad->romname, warmup, frames,
+	       (dgen_pal ? "PAL" : "NTSC"), (int)dgen_hz,
+	       (video ? "on" : "off"), bpp,
+	       (sound ? "on" : "off"), (long)dgen_soundrate);
+	total = (warmup + frames);
+	for (i = 0; (i != total); ++i) {
+		unsigned long start;
+
+		while ((next != input_len) && (input[next].frame <= i)) {
+			megad->pad[0] = input[next].pad[0];
+			megad->pad[1] = input[next].pad[1];
+			++next;
+		}
+		start = pd_usecs();
+		megad->one_frame((video ? &bm : NULL), NULL,
+				 (sound ? &si : NULL));
+		if (i < warmup)
+			continue;
+		usecs[(i - warmup)] = (pd_usecs() - start);
+		sum += usecs[(i - warmup)];
+		if (!check)
+			continue;
+		// Only the 320 pixels wide picture pd_graphics_update()
+		// shows, borders are scratch space for the renderer.
+		if (video) {
+			int y;
+
+			for (y = 8; (y != (bm.h - 8)); ++y)
+				video_sum = checksum(video_sum,
+						     (bm.data + (bm.pitch * y) +
+						      16),
+						     (320 *
+						      ((bpp + 7) / 8)));
+		}
+		if (sound)
+			sound_sum = checksum(sound_sum, si.lr,
+					     (si.len * sizeof(si.lr[0]) * 2));
+	}
+	std::sort(usecs, (usecs + frames));
+	{
+		double mean = ((double)sum / frames);
+		double wall = ((double)sum / 1000000.0);
+		double emulated = ((double)frames / dgen_hz);
+		unsigned long p99 = usecs[(((frames * 99) + 99) / 100) - 1];
+
+		printf("frames/second: %.2f\n"
+		       "usecs/frame:   mean %.1f, p99 %lu, min %lu, max %lu\n"
+		       "speed:         %.3fx (%.3fs emulated in %.3fs)\n",
+		       ((wall > 0.0) ? (frames / wall) : 0.0),
+		       mean, p99, usecs[0], usecs[(frames - 1)],
+		       ((wall > 0.0) ? (emulated / wall) : 0.0),
+		       emulated, wall);
+		if (check)
+			printf("checksums:     video %08x, sound %08x\n",
+			       video_sum, sound_sum);
+	}
+	free(bm.data);
+	free(si.lr);
+	free(usecs);
+	free(input);
+	megad->unplug();
+	delete megad;
+	return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef __BENCH_PD_DEFS_H__
+#define __BENCH_PD_DEFS_H__
+
+// Platform-dependent definitions for the headless benchmark runner.
+// Nothing here is ever matched against real keyboard events, the keysyms
+// only have to exist so that rc-vars.h can set its defaults. The values
+// follow SDL 1.2 so that rc files stay interchangeable.
+
+#define PDK_ESCAPE 27
+#define PDK_BACKSPACE 8
+#define PDK_TAB 9
+#define PDK_RETURN 13
+#define PDK_KP_MULTIPLY 268
+#define PDK_SPACE 32
+#define PDK_F1 282
+#define PDK_F2 283
+#define PDK_F3 284
+#define PDK_F4 285
+#define PDK_F5 286
+#define PDK_F6 287
+#define PDK_F7 288
+#define PDK_F8 289
+#define PDK_F9 290
+#define PDK_F10 291
+#define PDK_KP7 263
+#define PDK_KP8 264
+#define PDK_KP9 265
+#define PDK_KP_MINUS 269
+#define PDK_KP4 260
+#define PDK_KP5 261
+#define PDK_KP6 262
+#define PDK_KP_PLUS 270
+#define PDK_KP1 257
+#define PDK_KP2 258
+#define PDK_KP3 259
+#define PDK_KP0 256
+#define PDK_KP_PERIOD 266
+#define PDK_F11 292
+#define PDK_F12 293
+#define PDK_KP_ENTER 271
+#define PDK_KP_DIVIDE 267
+#define PDK_HOME 278
+#define PDK_UP 273
+#define PDK_PAGEUP 280
+#define PDK_LEFT 276
+#define PDK_RIGHT 275
+#define PDK_END 279
+#define PDK_DOWN 274
+#define PDK_PAGEDOWN 281
+#define PDK_INSERT 277
+#define PDK_DELETE 127
+#define PDK_NUMLOCK 300
+#define PDK_CAPSLOCK 301
+#define PDK_SCROLLOCK 302
+#define PDK_LSHIFT 304
+#define PDK_RSHIFT 303
+#define PDK_LCTRL 306
+#define PDK_RCTRL 305
+#define PDK_LALT 308
+#define PDK_RALT 307
+#define PDK_LMETA 310
+#define PDK_RMETA 309
+
+#endif // __BENCH_PD_DEFS_H__
@@ -107,6 +107,16 @@
 #include <math.h>
 #include "fm.h"
 
+#if FM_BLOCK
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define FM_BLOCK_AVX2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+#endif
+
 
 #ifndef PI
 #define PI 3.14159265358979323846
@@ -1480,6 +1490,29 @@ INLINE void update_phase_lfo_channel(FM_OPN *OPN, FM_CH *CH)
 	}
 }
 
+INLINE void chan_phase(FM_OPN *OPN, FM_CH *CH, int chnum)
+{
+	if(CH->pms)
+	{
+		/* add support for 3 slot mode */
+		if ((OPN->ST.mode & 0xC0) && (chnum == 2))
+		{
+		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT1], CH->pms, OPN->SL3.block_fnum[1]);
+		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT2], CH->pms, OPN->SL3.block_fnum[2]);
+		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT3], CH->pms, OPN->SL3.block_fnum[0]);
+		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT4], CH->pms, CH->block_fnum);
+		}
+		else update_phase_lfo_channel(OPN, CH);
+	}
+	else	/* no LFO phase modulation */
+	{
+		CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
+		CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
+		CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
+		CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
+	}
+}
+
 INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
 {
 	unsigned int eg_out;
@@ -1533,27 +1566,578 @@ INLINE void chan_calc(FM_OPN *OPN, FM_CH *CH, int chnum)
 	CH->mem_value = mem;
 
 	/* update phase counters AFTER output calculations */
-	if(CH->pms)
+	chan_phase(OPN, CH, chnum);
+}
+
+/* A channel is idle when all its operators are off and silent and nothing
+   is left in its feedback and MEM registers, chan_calc() would only advance
+   phase counters which are reset on key on anyway. */
+INLINE int chan_idle(FM_CH *CH)
+{
+	int s;
+
+	if (CH->op1_out[0] | CH->op1_out[1] | CH->mem_value)
+		return 0;
+	for (s = 0; (s != 4); ++s)
+		if ((CH->SLOT[s].state != EG_OFF) ||
+		    (CH->SLOT[s].vol_out < ENV_QUIET))
+			return 0;
+	return 1;
+}
+
+#if FM_BLOCK
+/*
+** Block synthesis.
+**
+** Does what chan_calc() would for up to FM_BLOCK_LEN samples at once, one
+** operator after the other:
+**  - chan_block_gen() replays the phase generator and the EG of a channel
+**    to know the phase and envelope of each operator for every sample, and
+**    calculates M1 when it has no feedback,
+**  - chan_block_fb() calculates M1 with feedback for all channels at once,
+**  - chan_block() calculates the other operators. They are run in C1, M2,
+**    C2 order instead of M2, C1, C2 since MEM (written by M1 and C1 only)
+**    has to be known before M2 and C2, this doesn't change anything for
+**    other connections.
+**
+** Output is identical to chan_calc(). YM2612 only.
+*/
+
+#define FM_BLOCK_LEN	64
+
+/* block state of a channel */
+typedef struct
+{
+	UINT32	phase[4][FM_BLOCK_LEN];	/* phase of each operator */
+	UINT32	vol[4][FM_BLOCK_LEN];	/* EG output of each operator */
+	INT32	op1[FM_BLOCK_LEN + 2];	/* M1 output history (feedback) */
+	int		heard[4];				/* operators not always quiet */
+} FM_BLOCK_CH;
+
+static struct
+{
+	UINT32	am[FM_BLOCK_LEN];		/* LFO_AM for each sample */
+	INT32	pm[FM_BLOCK_LEN];		/* LFO_PM for each sample */
+	UINT32	eg[FM_BLOCK_LEN];		/* EG ticks up to the end of each sample */
+	FM_BLOCK_CH	ch[6];
+	INT32	m2[FM_BLOCK_LEN];		/* same as m2, c1, c2 and mem */
+	INT32	c1[FM_BLOCK_LEN];
+	INT32	c2[FM_BLOCK_LEN];
+	INT32	mem[FM_BLOCK_LEN];
+	INT32	out[FM_BLOCK_LEN];		/* channel output */
+	INT32	lt[FM_BLOCK_LEN];		/* mixed output */
+	INT32	rt[FM_BLOCK_LEN];
+} fmb;
+
+/* phase counters of an operator with a constant increment */
+static void op_phase_block(UINT32 *dst, UINT32 phase, UINT32 incr,
+			   unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	__m128i v = _mm_set_epi32((phase + (incr * 3)), (phase + (incr * 2)),
+				  (phase + incr), phase);
+	__m128i step = _mm_set1_epi32(incr * 4);
+
+	for (; ((i + 4) <= n); i += 4)
 	{
-		/* add support for 3 slot mode */
-		if ((OPN->ST.mode & 0xC0) && (chnum == 2))
+		_mm_storeu_si128((__m128i *)&dst[i], v);
+		v = _mm_add_epi32(v, step);
+	}
+	phase += (incr * i);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	static const uint32_t lane[4] = { 0, 1, 2, 3 };
+	uint32x4_t v = vmlaq_n_u32(vdupq_n_u32(phase), vld1q_u32(lane), incr);
+	uint32x4_t step = vdupq_n_u32(incr * 4);
+
+	for (; ((i + 4) <= n); i += 4)
+	{
+		vst1q_u32(&dst[i], v);
+		v = vaddq_u32(v, step);
+	}
+	phase += (incr * i);
+#endif
+	for (; (i != n); ++i)
+	{
+		dst[i] = phase;
+		phase += incr;
+	}
+}
+
+/*
+  Add the output of an operator to dst for n samples. vol is the EG
+  output to which AM (LFO_AM >> ams) is added, pm is the modulation input
+  (may be NULL).
+*/
+static void op_calc_block_c(INT32 *dst, const UINT32 *phase,
+			    const UINT32 *vol, const UINT32 *am,
+			    unsigned int ams, UINT32 AMmask, const INT32 *pm,
+			    unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i fmask = _mm_set1_epi32(~FREQ_MASK);
+	const __m128i smask = _mm_set1_epi32(SIN_MASK);
+	const __m128i tl_len = _mm_set1_epi32(TL_TAB_LEN);
+	const __m128i shift = _mm_cvtsi32_si128(ams);
+	const __m128i amask = _mm_set1_epi32(AMmask);
+
+	for (; ((i + 4) <= n); i += 4)
+	{
+		UINT32 s[4];
+		INT32 t[4];
+		__m128i p;
+		__m128i e;
+		__m128i ok;
+
+		/* sin_tab index */
+		p = _mm_and_si128(_mm_loadu_si128((const __m128i *)&phase[i]),
+				  fmask);
+		if (pm != NULL)
+			p = _mm_add_epi32(p, _mm_slli_epi32
+					  (_mm_loadu_si128((const __m128i *)
+							   &pm[i]), 15));
+		p = _mm_and_si128(_mm_srli_epi32(p, FREQ_SH), smask);
+		_mm_storeu_si128((__m128i *)s, p);
+		s[0] = sin_tab[s[0]];
+		s[1] = sin_tab[s[1]];
+		s[2] = sin_tab[s[2]];
+		s[3] = sin_tab[s[3]];
+		/* envelope with AM */
+		e = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)&am[i]),
+				  shift);
+		e = _mm_add_epi32(_mm_and_si128(e, amask),
+				  _mm_loadu_si128((const __m128i *)&vol[i]));
+		/* tl_tab index */
+		p = _mm_add_epi32(_mm_slli_epi32(e, 3),
+				  _mm_loadu_si128((const __m128i *)s));
+		ok = _mm_cmplt_epi32(p, tl_len);
+		_mm_storeu_si128((__m128i *)t, _mm_and_si128(p, ok));
+		t[0] = tl_tab[t[0]];
+		t[1] = tl_tab[t[1]];
+		t[2] = tl_tab[t[2]];
+		t[3] = tl_tab[t[3]];
+		p = _mm_and_si128(_mm_loadu_si128((const __m128i *)t), ok);
+		p = _mm_add_epi32(p, _mm_loadu_si128((const __m128i *)&dst[i]));
+		_mm_storeu_si128((__m128i *)&dst[i], p);
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint32x4_t fmask = vdupq_n_u32(~FREQ_MASK);
+	const uint32x4_t smask = vdupq_n_u32(SIN_MASK);
+	const uint32x4_t tl_len = vdupq_n_u32(TL_TAB_LEN);
+	const int32x4_t shift = vdupq_n_s32(-(int)ams);
+	const uint32x4_t amask = vdupq_n_u32(AMmask);
+
+	for (; ((i + 4) <= n); i += 4)
+	{
+		UINT32 s[4];
+		INT32 t[4];
+		uint32x4_t p;
+		uint32x4_t e;
+		uint32x4_t ok;
+
+		/* sin_tab index */
+		p = vandq_u32(vld1q_u32(&phase[i]), fmask);
+		if (pm != NULL)
+			p = vaddq_u32(p, vshlq_n_u32(vreinterpretq_u32_s32
+						     (vld1q_s32(&pm[i])), 15));
+		p = vandq_u32(vshrq_n_u32(p, FREQ_SH), smask);
+		vst1q_u32(s, p);
+		s[0] = sin_tab[s[0]];
+		s[1] = sin_tab[s[1]];
+		s[2] = sin_tab[s[2]];
+		s[3] = sin_tab[s[3]];
+		/* envelope with AM */
+		e = vandq_u32(vshlq_u32(vld1q_u32(&am[i]), shift), amask);
+		e = vaddq_u32(e, vld1q_u32(&vol[i]));
+		/* tl_tab index */
+		p = vaddq_u32(vshlq_n_u32(e, 3), vld1q_u32(s));
+		ok = vcltq_u32(p, tl_len);
+		vst1q_s32(t, vreinterpretq_s32_u32(vandq_u32(p, ok)));
+		t[0] = tl_tab[t[0]];
+		t[1] = tl_tab[t[1]];
+		t[2] = tl_tab[t[2]];
+		t[3] = tl_tab[t[3]];
+		p = vandq_u32(vreinterpretq_u32_s32(vld1q_s32(t)), ok);
+		vst1q_s32(&dst[i], vaddq_s32(vld1q_s32(&dst[i]),
+					     vreinterpretq_s32_u32(p)));
+	}
+#endif
+	for (; (i != n); ++i)
+		dst[i] += op_calc(phase[i], (vol[i] + ((am[i] >> ams) & AMmask)),
+				  ((pm != NULL) ? pm[i] : 0));
+}
+
+#ifdef FM_BLOCK_AVX2
+
+/* same with AVX2 gathers */
+__attribute__((__target__("avx2")))
+static void op_calc_block_avx2(INT32 *dst, const UINT32 *phase,
+			       const UINT32 *vol, const UINT32 *am,
+			       unsigned int ams, UINT32 AMmask,
+			       const INT32 *pm, unsigned int n)
+{
+	const __m256i fmask = _mm256_set1_epi32(~FREQ_MASK);
+	const __m256i smask = _mm256_set1_epi32(SIN_MASK);
+	const __m256i tl_len = _mm256_set1_epi32(TL_TAB_LEN);
+	const __m128i shift = _mm_cvtsi32_si128(ams);
+	const __m256i amask = _mm256_set1_epi32(AMmask);
+	unsigned int i = 0;
+
+	for (; ((i + 8) <= n); i += 8)
+	{
+		__m256i p;
+		__m256i e;
+		__m256i ok;
+
+		p = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)
+							&phase[i]), fmask);
+		if (pm != NULL)
+			p = _mm256_add_epi32(p, _mm256_slli_epi32
+					     (_mm256_loadu_si256
+					      ((const __m256i *)&pm[i]), 15));
+		p = _mm256_and_si256(_mm256_srli_epi32(p, FREQ_SH), smask);
+		p = _mm256_i32gather_epi32((const int *)sin_tab, p, 4);
+		e = _mm256_srl_epi32(_mm256_loadu_si256((const __m256i *)
+							&am[i]), shift);
+		e = _mm256_add_epi32(_mm256_and_si256(e, amask),
+				     _mm256_loadu_si256((const __m256i *)
+							&vol[i]));
+		p = _mm256_add_epi32(_mm256_slli_epi32(e, 3), p);
+		ok = _mm256_cmpgt_epi32(tl_len, p);
+		p = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+						(const int *)tl_tab, p, ok, 4);
+		p = _mm256_add_epi32(p, _mm256_loadu_si256((const __m256i *)
+							   &dst[i]));
+		_mm256_storeu_si256((__m256i *)&dst[i], p);
+	}
+	if (i != n)
+		op_calc_block_c(&dst[i], &phase[i], &vol[i], &am[i], ams,
+				AMmask, ((pm != NULL) ? &pm[i] : NULL), (n - i));
+}
+
+#endif /* FM_BLOCK_AVX2 */
+
+static void (*op_calc_block)(INT32 *dst, const UINT32 *phase,
+			     const UINT32 *vol, const UINT32 *am,
+			     unsigned int ams, UINT32 AMmask, const INT32 *pm,
+			     unsigned int n) = op_calc_block_c;
+
+static void op_calc_block_init(void)
+{
+#ifdef FM_BLOCK_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		op_calc_block = op_calc_block_avx2;
+#endif
+}
+
+/*
+  advance_eg_channel() only changes something when eg_cnt has all the
+  returned bits cleared. Zero means it must be called at every tick.
+*/
+static UINT32 chan_block_eg_mask(FM_CH *CH)
+{
+	UINT32 mask = ~0;
+	unsigned int s;
+
+	for (s = 0; (s != 4); ++s)
+	{
+		FM_SLOT *SLOT = &CH->SLOT[s];
+
+		/* SSG-EG, or vol_out not updated since a TL change */
+		if ((SLOT->ssg & 0x08) ||
+		    (SLOT->vol_out != (UINT32)(SLOT->volume + SLOT->tl)))
+			return 0;
+		switch (SLOT->state)
 		{
-		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT1], CH->pms, OPN->SL3.block_fnum[1]);
-		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT2], CH->pms, OPN->SL3.block_fnum[2]);
-		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT3], CH->pms, OPN->SL3.block_fnum[0]);
-		        update_phase_lfo_slot(OPN, &CH->SLOT[SLOT4], CH->pms, CH->block_fnum);
+		case EG_ATT:
+			mask &= ((1 << SLOT->eg_sh_ar) - 1);
+			break;
+		case EG_DEC:
+			/* transition to sustain is checked at every tick */
+			if (SLOT->volume >= (INT32)SLOT->sl)
+				return 0;
+			mask &= ((1 << SLOT->eg_sh_d1r) - 1);
+			break;
+		case EG_SUS:
+			mask &= ((1 << SLOT->eg_sh_d2r) - 1);
+			break;
+		case EG_REL:
+			mask &= ((1 << SLOT->eg_sh_rr) - 1);
+			break;
 		}
-		else update_phase_lfo_channel(OPN, CH);
 	}
-	else	/* no LFO phase modulation */
+	return mask;
+}
+
+/* store current EG output for samples [from, to) */
+INLINE void chan_block_vol(FM_CH *CH, FM_BLOCK_CH *B, unsigned int from,
+			   unsigned int to)
+{
+	unsigned int s;
+	unsigned int i;
+
+	for (s = 0; (s != 4); ++s)
 	{
-		CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
-		CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
-		CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
-		CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
+		UINT32 vol_out = CH->SLOT[s].vol_out;
+
+		if (vol_out < ENV_QUIET)
+			B->heard[s] = 1;
+		for (i = from; (i < to); ++i)
+			B->vol[s][i] = vol_out;
 	}
 }
 
+/* replay EG for n samples, also the phase generator if ssg is set since
+   SSG-EG may restart it */
+static void chan_block_eg(FM_OPN *OPN, FM_CH *CH, FM_BLOCK_CH *B, int chnum,
+			  unsigned int n, int ssg)
+{
+	FM_SLOT *SLOT = CH->SLOT;
+	UINT32 mask = chan_block_eg_mask(CH);
+	UINT32 tick = 0;
+	unsigned int pos = 0;
+	unsigned int i = 0;
+	unsigned int s;
+
+	B->heard[0] = B->heard[1] = B->heard[2] = B->heard[3] = 0;
+	if (ssg)
+	{
+		for (i = 0; (i != n); ++i)
+		{
+			chan_block_vol(CH, B, i, (i + 1));
+			for (s = 0; (s != 4); ++s)
+				B->phase[s][i] = SLOT[s].phase;
+			LFO_PM = fmb.pm[i];
+			chan_phase(OPN, CH, chnum);
+			for (; (tick != fmb.eg[i]); ++tick)
+			{
+				OPN->eg_cnt++;
+				if (OPN->eg_cnt & mask)
+					continue;
+				advance_eg_channel(OPN, &SLOT[SLOT1]);
+				mask = chan_block_eg_mask(CH);
+			}
+		}
+		return;
+	}
+	/* jump from one useful tick to the next */
+	while (1)
+	{
+		UINT32 skip = (mask - (OPN->eg_cnt & mask));
+
+		if (skip >= (fmb.eg[(n - 1)] - tick))
+		{
+			OPN->eg_cnt += (fmb.eg[(n - 1)] - tick);
+			break;
+		}
+		tick += (skip + 1);
+		OPN->eg_cnt += (skip + 1);
+		/* EG output before this tick is used until the end of the
+		   sample in which it occurs */
+		while (fmb.eg[i] < tick)
+			++i;
+		chan_block_vol(CH, B, pos, (i + 1));
+		pos = (i + 1);
+		advance_eg_channel(OPN, &SLOT[SLOT1]);
+		mask = chan_block_eg_mask(CH);
+	}
+	chan_block_vol(CH, B, pos, n);
+}
+
+/* phase counters for n samples, LFO PM only changes every few samples */
+static void chan_block_phase(FM_OPN *OPN, FM_CH *CH, FM_BLOCK_CH *B,
+			     int chnum, unsigned int n)
+{
+	FM_SLOT *SLOT = CH->SLOT;
+	unsigned int i;
+	unsigned int j;
+	unsigned int s;
+
+	for (i = 0; (i != n); i = j)
+	{
+		UINT32 phase[4];
+
+		j = n;
+		if (CH->pms)
+			for (j = (i + 1); ((j != n) && (fmb.pm[j] == fmb.pm[i])); ++j)
+				;
+		/* get increments from chan_phase() */
+		for (s = 0; (s != 4); ++s)
+		{
+			phase[s] = SLOT[s].phase;
+			SLOT[s].phase = 0;
+		}
+		LFO_PM = fmb.pm[i];
+		chan_phase(OPN, CH, chnum);
+		for (s = 0; (s != 4); ++s)
+		{
+			UINT32 incr = SLOT[s].phase;
+
+			op_phase_block(&B->phase[s][i], phase[s], incr, (j - i));
+			SLOT[s].phase = (phase[s] + (incr * (j - i)));
+		}
+	}
+}
+
+/* phase, EG and M1 output without feedback for n samples */
+static void chan_block_gen(FM_OPN *OPN, FM_CH *CH, FM_BLOCK_CH *B, int chnum,
+			   unsigned int n)
+{
+	FM_SLOT *SLOT = CH->SLOT;
+	int ssg = 0;
+	unsigned int s;
+
+	for (s = 0; (s != 4); ++s)
+		if (SLOT[s].ssg & 0x08)
+			ssg = 1;
+	if (!ssg)
+		chan_block_phase(OPN, CH, B, chnum, n);
+	chan_block_eg(OPN, CH, B, chnum, n, ssg);
+	B->op1[0] = CH->op1_out[0];
+	B->op1[1] = CH->op1_out[1];
+	memset(&B->op1[2], 0, (sizeof(B->op1[0]) * n));
+	if ((!CH->FB) && (B->heard[SLOT1]))
+		op_calc_block(&B->op1[2], B->phase[SLOT1], B->vol[SLOT1], fmb.am,
+			      CH->ams, SLOT[SLOT1].AMmask, NULL, n);
+}
+
+/*
+  M1 output with feedback for n samples. Each sample depends on the
+  previous ones, channels are interleaved so that they don't wait for each
+  other.
+*/
+static void chan_block_fb(FM_CH **CH, FM_BLOCK_CH **B, unsigned int nch,
+			  unsigned int n)
+{
+	unsigned int i;
+	unsigned int c;
+
+	for (i = 0; (i != n); ++i)
+		for (c = 0; (c != nch); ++c)
+		{
+			INT32 *op1 = B[c]->op1;
+			UINT32 eg_out = (B[c]->vol[SLOT1][i] +
+					 ((fmb.am[i] >> CH[c]->ams) &
+					  CH[c]->SLOT[SLOT1].AMmask));
+
+			if (eg_out < ENV_QUIET)
+				op1[(i + 2)] = op_calc1(B[c]->phase[SLOT1][i], eg_out,
+							((op1[i] + op1[(i + 1)])
+							 << CH[c]->FB));
+		}
+}
+
+/* block buffer corresponding to a connection */
+INLINE INT32 *chan_block_connect(INT32 *connect)
+{
+	if (connect == &m2)
+		return fmb.m2;
+	if (connect == &c1)
+		return fmb.c1;
+	if (connect == &c2)
+		return fmb.c2;
+	if (connect == &mem)
+		return fmb.mem;
+	return fmb.out;
+}
+
+/* m2, c1, c2 and mem buffers written to with this algorithm */
+#define FMB_M2	0x01
+#define FMB_C1	0x02
+#define FMB_C2	0x04
+#define FMB_MEM	0x08
+
+INLINE unsigned int chan_block_used(INT32 *connect)
+{
+	if (connect == &m2)
+		return FMB_M2;
+	if (connect == &c1)
+		return FMB_C1;
+	if (connect == &c2)
+		return FMB_C2;
+	if (connect == &mem)
+		return FMB_MEM;
+	return 0;
+}
+
+/* remaining operators once M1 is known, output goes to fmb.out */
+static void chan_block(FM_CH *CH, FM_BLOCK_CH *B, unsigned int n)
+{
+	FM_SLOT *SLOT = CH->SLOT;
+	INT32 *op1 = B->op1;
+	INT32 *dst;
+	unsigned int used;
+	unsigned int i;
+
+	/* clear buffers, operators whose input isn't connected get none */
+	used = (chan_block_used(CH->connect2) | chan_block_used(CH->connect3));
+	if (CH->connect1)
+		used |= chan_block_used(CH->connect1);
+	else
+		used |= (FMB_C1 | FMB_C2 | FMB_MEM);
+	if (CH->mem_connect != &mem)
+		used |= chan_block_used(CH->mem_connect);
+	if (used & FMB_M2)
+		memset(fmb.m2, 0, (sizeof(fmb.m2[0]) * n));
+	if (used & FMB_C1)
+		memset(fmb.c1, 0, (sizeof(fmb.c1[0]) * n));
+	if (used & FMB_C2)
+		memset(fmb.c2, 0, (sizeof(fmb.c2[0]) * n));
+	if (used & FMB_MEM)
+		memset(fmb.mem, 0, (sizeof(fmb.mem[0]) * n));
+	memset(fmb.out, 0, (sizeof(fmb.out[0]) * n));
+
+	/* M1, its output is used one sample later */
+	CH->op1_out[0] = op1[n];
+	CH->op1_out[1] = op1[(n + 1)];
+	if (!CH->connect1)
+	{
+		/* algorithm 5 */
+		for (i = 0; (i != n); ++i)
+			fmb.mem[i] = fmb.c1[i] = fmb.c2[i] = op1[(i + 1)];
+	}
+	else
+	{
+		dst = chan_block_connect(CH->connect1);
+		for (i = 0; (i != n); ++i)
+			dst[i] += op1[(i + 1)];
+	}
+
+	/* C1 */
+	if (B->heard[SLOT2])
+		op_calc_block(chan_block_connect(CH->connect2), B->phase[SLOT2],
+			      B->vol[SLOT2], fmb.am, CH->ams, SLOT[SLOT2].AMmask,
+			      ((used & FMB_C1) ? fmb.c1 : NULL), n);
+
+	/* restore delayed sample (MEM) */
+	if (CH->mem_connect != &mem)
+	{
+		dst = chan_block_connect(CH->mem_connect);
+		dst[0] += CH->mem_value;
+		for (i = 1; (i != n); ++i)
+			dst[i] += fmb.mem[(i - 1)];
+		CH->mem_value = fmb.mem[(n - 1)];
+	}
+
+	/* M2 */
+	if (B->heard[SLOT3])
+		op_calc_block(chan_block_connect(CH->connect3), B->phase[SLOT3],
+			      B->vol[SLOT3], fmb.am, CH->ams, SLOT[SLOT3].AMmask,
+			      ((used & FMB_M2) ? fmb.m2 : NULL), n);
+
+	/* C2 */
+	if (B->heard[SLOT4])
+		op_calc_block(chan_block_connect(CH->connect4), B->phase[SLOT4],
+			      B->vol[SLOT4], fmb.am, CH->ams, SLOT[SLOT4].AMmask,
+			      ((used & FMB_C2) ? fmb.c2 : NULL), n);
+}
+
+#endif /* FM_BLOCK */
+
 /* update phase increment and envelope generator */
 INLINE void refresh_fc_eg_slot(FM_OPN *OPN, FM_SLOT *SLOT , int fc , int kc )
 {
@@ -4735,6 +5319,144 @@ static YM2612 *FM2612=NULL;	/* array of YM2612's */
 
 static int dacen;
 
+/* advance envelope generator of active channels */
+INLINE void YM2612AdvanceEG(FM_OPN *OPN, unsigned int active)
+{
+	OPN->eg_timer += OPN->eg_timer_add;
+	while (OPN->eg_timer >= OPN->eg_timer_overflow)
+	{
+		unsigned int c;
+
+		OPN->eg_timer -= OPN->eg_timer_overflow;
+		OPN->eg_cnt++;
+
+		for (c = 0; (c != 6); ++c)
+			if (active & (1 << c))
+				advance_eg_channel(OPN, &cch[c]->SLOT[SLOT1]);
+	}
+}
+
+/* mix a stereo sample with buffer */
+INLINE void YM2612Mix(INT16 *buffer, int32_t lt, int32_t rt,
+		      unsigned int volume, int loud)
+{
+	/* Mix with buffer. */
+	lt += buffer[0];
+	/* Make it louder. */
+	if (loud)
+		lt = ((lt * 3) >> 1);
+	/* Lower volume? */
+	if (volume != 100)
+		lt = ((lt * (int)volume) / 100);
+	/* Hard clipping for signed 16-bit output. */
+	lt = ((abs(lt + 32767) - abs(lt - 32767)) >> 1);
+	buffer[0] = lt;
+
+	rt += buffer[1];
+	if (loud)
+		rt = ((rt * 3) >> 1);
+	if (volume != 100)
+		rt = ((rt * (int)volume) / 100);
+	rt = ((abs(rt + 32767) - abs(rt - 32767)) >> 1);
+	buffer[1] = rt;
+}
+
+#if FM_BLOCK
+/* YM2612UpdateOne() buffering loop, by blocks */
+static void YM2612UpdateBlock(FM_OPN *OPN, INT16 *buffer, unsigned int length,
+			      unsigned int volume, int loud,
+			      unsigned int active, unsigned int calc,
+			      INT32 dacout)
+{
+	while (length)
+	{
+		unsigned int n = ((length < FM_BLOCK_LEN) ? length : FM_BLOCK_LEN);
+		UINT32 eg_cnt = OPN->eg_cnt;
+		UINT32 eg_ticks = 0;
+		FM_CH *fb_ch[6];
+		FM_BLOCK_CH *fb_b[6];
+		unsigned int fb = 0;
+		unsigned int i;
+		unsigned int c;
+
+		/* LFO and EG timer for each sample */
+		for (i = 0; (i != n); ++i)
+		{
+			advance_lfo(OPN);
+			fmb.am[i] = LFO_AM;
+			fmb.pm[i] = LFO_PM;
+			OPN->eg_timer += OPN->eg_timer_add;
+			while (OPN->eg_timer >= OPN->eg_timer_overflow)
+			{
+				OPN->eg_timer -= OPN->eg_timer_overflow;
+				++eg_ticks;
+			}
+			fmb.eg[i] = eg_ticks;
+		}
+
+		/* phase, EG and M1 of each channel */
+		for (c = 0; (c != 6); ++c)
+		{
+			if (!(active & (1 << c)))
+				continue;
+			OPN->eg_cnt = eg_cnt;
+			if (!(calc & (1 << c)))
+			{
+				/* replaced by DAC, only advance EG */
+				chan_block_eg(OPN, cch[c], &fmb.ch[c], c, n, 0);
+				continue;
+			}
+			chan_block_gen(OPN, cch[c], &fmb.ch[c], c, n);
+			if ((cch[c]->FB) && (fmb.ch[c].heard[SLOT1]))
+			{
+				fb_ch[fb] = cch[c];
+				fb_b[fb] = &fmb.ch[c];
+				++fb;
+			}
+		}
+		OPN->eg_cnt = (eg_cnt + eg_ticks);
+		if (fb)
+			chan_block_fb(fb_ch, fb_b, fb, n);
+
+		/* other operators and mixing */
+		memset(fmb.lt, 0, (sizeof(fmb.lt[0]) * n));
+		memset(fmb.rt, 0, (sizeof(fmb.rt[0]) * n));
+		for (c = 0; (c != 6); ++c)
+		{
+			INT32 pl = OPN->pan[(c * 2)];
+			INT32 pr = OPN->pan[((c * 2) + 1)];
+
+			if (!(calc & (1 << c)))
+				continue;
+			chan_block(cch[c], &fmb.ch[c], n);
+			for (i = 0; (i != n); ++i)
+			{
+				fmb.lt[i] += (fmb.out[i] & pl);
+				fmb.rt[i] += (fmb.out[i] & pr);
+			}
+		}
+
+		for (i = 0; (i != n); ++i)
+		{
+			int32_t lt = fmb.lt[i];
+			int32_t rt = fmb.rt[i];
+
+			if (dacen)
+			{
+				lt += (dacout & OPN->pan[10]);
+				rt += (dacout & OPN->pan[11]);
+			}
+			YM2612Mix(buffer, (lt >> FINAL_SH), (rt >> FINAL_SH),
+				  volume, loud);
+			buffer += 2;
+			/* timer A control */
+			INTERNAL_TIMER_A(OPN->type, State, cch[2])
+		}
+		length -= n;
+	}
+}
+#endif /* FM_BLOCK */
+
 /* Generate samples for one of the YM2612s */
 void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 		     unsigned int volume, int loud)
@@ -4743,6 +5465,8 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 	FM_OPN *OPN   = &(FM2612[num].OPN);
 	unsigned int i;
 	INT32 dacout  = F2612->dacout;
+	unsigned int active = 0;	/* channels with a running EG */
+	unsigned int calc;		/* channels to calculate */
 	
 	if( (void *)F2612 != cur_chip ){
 		cur_chip = (void *)F2612;
@@ -4776,6 +5500,53 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 	refresh_fc_eg_chan( OPN, cch[4] );
 	refresh_fc_eg_chan( OPN, cch[5] );
 
+	/* Channels can only be keyed on between calls, except channel 3 by
+	   timer A in CSM mode. Those becoming idle during this call are
+	   still calculated until the next one. */
+	for (i = 0; (i != 6); ++i)
+		if (!chan_idle(cch[i]))
+			active |= (1 << i);
+	if (State->mode & 0x80)
+		active |= (1 << 2);
+	calc = active;
+	if (dacen)
+		calc &= ~(1 << 5);
+
+	if (!calc)
+	{
+		/* all channels are idle, only the DAC can be heard */
+		int32_t lt = 0;
+		int32_t rt = 0;
+
+		if (dacen)
+		{
+			lt = ((dacout & OPN->pan[10]) >> FINAL_SH);
+			rt = ((dacout & OPN->pan[11]) >> FINAL_SH);
+		}
+		for(i=0; i < length ; i++)
+		{
+			advance_lfo(OPN);
+			YM2612AdvanceEG(OPN, active);
+			YM2612Mix(buffer, lt, rt, volume, loud);
+			buffer += 2;
+			/* timer A control */
+			INTERNAL_TIMER_A(OPN->type, State, cch[2])
+		}
+		INTERNAL_TIMER_B(State,length)
+		return;
+	}
+
+#if FM_BLOCK
+	/* CSM mode may key on channel 3 between two samples */
+	if (!(State->mode & 0x80))
+	{
+		YM2612UpdateBlock(OPN, buffer, length, volume, loud, active, calc,
+				  dacout);
+		INTERNAL_TIMER_B(State,length)
+		return;
+	}
+#endif
+
 	/* buffering */
 	for(i=0; i < length ; i++)
 	{
@@ -4791,30 +5562,23 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 		out_fm[5] = 0;
 		
 		/* calculate FM */
-		chan_calc(OPN, cch[0], 0 );
-		chan_calc(OPN, cch[1], 1 );
-		chan_calc(OPN, cch[2], 2 );
-		chan_calc(OPN, cch[3], 3 );
-		chan_calc(OPN, cch[4], 4 );
+		if (calc & 0x01)
+			chan_calc(OPN, cch[0], 0 );
+		if (calc & 0x02)
+			chan_calc(OPN, cch[1], 1 );
+		if (calc & 0x04)
+			chan_calc(OPN, cch[2], 2 );
+		if (calc & 0x08)
+			chan_calc(OPN, cch[3], 3 );
+		if (calc & 0x10)
+			chan_calc(OPN, cch[4], 4 );
 		if( dacen )
 			*cch[5]->connect4 += dacout;
-		else
+		else if (calc & 0x20)
 			chan_calc(OPN, cch[5], 5 );
 
 		/* advance envelope generator */
-		OPN->eg_timer += OPN->eg_timer_add;
-		while (OPN->eg_timer >= OPN->eg_timer_overflow)
-		{
-			OPN->eg_timer -= OPN->eg_timer_overflow;
-			OPN->eg_cnt++;
-
-			advance_eg_channel(OPN, &cch[0]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[1]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[2]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[3]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[4]->SLOT[SLOT1]);
-			advance_eg_channel(OPN, &cch[5]->SLOT[SLOT1]);
-		}
+		YM2612AdvanceEG(OPN, active);
 
 		{
 			int32_t lt, rt;
@@ -4844,25 +5608,8 @@ void YM2612UpdateOne(int num, INT16 *buffer, unsigned int length,
 				SAVE_ALL_CHANNELS
 			#endif
 
-			/* Mix with buffer. */
-			lt += *buffer;
-			/* Make it louder. */
-			if (loud)
-				lt = ((lt * 3) >> 1);
-			/* Lower volume? */
-			if (volume != 100)
-				lt = ((lt * (int)volume) / 100);
-			/* Hard clipping for signed 16-bit output. */
-			lt = ((abs(lt + 32767) - abs(lt - 32767)) >> 1);
-			*(buffer++) = lt;
-
-			rt += *buffer;
-			if (loud)
-				rt = ((rt * 3) >> 1);
-			if (volume != 100)
-				rt = ((rt * (int)volume) / 100);
-			rt = ((abs(rt + 32767) - abs(rt - 32767)) >> 1);
-			*(buffer++) = rt;
+			YM2612Mix(buffer, lt, rt, volume, loud);
+			buffer += 2;
 		}
 
 		/* timer A control */
@@ -4940,6 +5687,9 @@ int YM2612Init(int num, int clock, int rate, int mjazz,
 		return (-1);
 	/* clear */
 	memset(FM2612,0,sizeof(YM2612) * YM2612NumChips);
+#if FM_BLOCK
+	op_calc_block_init();
+#endif
 	/* allocate total level table (128kb space) */
 	if( !init_tables() )
 	{
@@ -28,6 +28,18 @@
 /* busy flag enulation , The definition of FM_GET_TIME_NOW() is necessary. */
 #define FM_BUSY_FLAG_SUPPORT 0
 
+/* YM2612 synthesis by blocks of samples, using SIMD (SSE2, AVX2, NEON) */
+/* when available. Otherwise the per sample code, which is the reference, */
+/* is used. */
+#ifndef FM_BLOCK
+#if defined(__GNUC__) && \
+	(defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define FM_BLOCK 1
+#else
+#define FM_BLOCK 0
+#endif
+#endif
+
 /* --- external SSG(YM2149/AY-3-8910)emulator interface port */
 /* used by YM2203,YM2608,and YM2610 */
 
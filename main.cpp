@@ -35,8 +35,8 @@
 static long dgen_mingw_detach = 1;
 #endif
 
-// Defined in ras.cpp, and set to true if the Genesis palette's changed.
-extern int pal_dirty;
+// Frames skipped in a row by automatic frameskip before drawing anyway.
+#define FRAMESKIP_MAX 8
 
 FILE *debug_log = NULL;
 
@@ -138,6 +138,7 @@ int dgen(char* romname)
 {
   int c = 0, stop = 0, usec = 0, start_slot = -1;
   unsigned long frames, frames_old, fps;
+  intptr_t skip;
   char *patches = NULL, *rom = NULL;
   unsigned long oldclk, newclk, startclk, fpsclk;
   FILE *file = NULL;
@@ -258,18 +259,49 @@ next_rom:
 	frames = 0;
 	frames_old = 0;
 	fps = 0;
+	skip = 0;
+	oldclk = pd_usecs();
 	while (!stop) {
+		int usec_frame = (1000000 / dgen_hz);
+		bool draw = true;
+
+		if (dgen_frameskip_fixed > 0) {
+			// Draw one frame out of (dgen_frameskip_fixed + 1).
+			draw = (skip >= dgen_frameskip_fixed);
+		}
+		else if (dgen_frameskip) {
+			// Keep track of how late we are, without ever getting
+			// ahead of schedule, and skip drawing while late by
+			// more than a frame.
+			newclk = pd_usecs();
+			usec += ((int)(newclk - oldclk) - usec_frame);
+			oldclk = newclk;
+			if (usec < 0)
+				usec = 0;
+			else if (usec > (usec_frame * FRAMESKIP_MAX))
+				usec = (usec_frame * FRAMESKIP_MAX);
+			draw = ((usec < usec_frame) || (skip >= FRAMESKIP_MAX));
+		}
+		if (draw)
+			skip = 0;
+		else
+			++skip;
+		// Skipped frames are emulated with a NULL bitmap.
 #ifndef NOSOUND
 			if (dgen_sound) {
-				megad->one_frame(&mdscr, mdpal, &sndi);
+				megad->one_frame((draw ? &mdscr : NULL),
+						 (draw ? mdpal : NULL), &sndi);
 				pd_sound_write();
 			}
 			else
 #endif
-			megad->one_frame(&mdscr, mdpal, NULL);
+			megad->one_frame((draw ? &mdscr : NULL),
+					 (draw ? mdpal : NULL), NULL);
 
+		if (draw) {
 			pd_graphics_update(megad->plugged);
 			++frames;
+		}
 		stop |= (pd_handle_events(*megad) ^ 1);
 	}
 
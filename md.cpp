@@ -306,6 +306,7 @@ int md::reset()
   z80_st_busreq = 1;
   z80_st_reset = 1;
   z80_st_irq = 0;
+  misc_memory_map();
   return 0;
 }
 
@@ -478,15 +479,26 @@ bool md::init_sound()
 		(void)0;
 		ok_sn76496 = false;
 	}
+	resample_free(snd_rs);
+	snd_rs = NULL;
+	snd_rate = dgen_soundrate;
+	// Run the chips at the YM2612 sample rate (MCLK/7/144), the result
+	// is resampled to dgen_soundrate by may_want_to_get_sound().
+	if (dgen_sound_native) {
+		unsigned int rate = ((((pal) ? PAL_MCLK : NTSC_MCLK) / 7) / 144);
+
+		if ((snd_rs = resample_new(rate, dgen_soundrate)) != NULL)
+			snd_rate = rate;
+	}
 	// Initialize two additional chips when MJazz is enabled.
 	if (YM2612Init((dgen_mjazz ? 3 : 1),
 		       (((pal) ? PAL_MCLK : NTSC_MCLK) / 7),
-		       dgen_soundrate, dgen_mjazz, NULL, NULL))
+		       snd_rate, dgen_mjazz, NULL, NULL))
 		return false;
 	ok_ym2612 = true;
 	if (SN76496_init(0,
 			 (((pal) ? PAL_MCLK : NTSC_MCLK) / 15),
-			 dgen_soundrate, 16))
+			 snd_rate, 16))
 		return false;
 	ok_sn76496 = true;
 	return true;
@@ -546,7 +558,12 @@ md::md(bool pal, char region):
 	md_mz80_ref(0), md_mz80_prev(0),
 #endif
 	pal(pal), ok_ym2612(false), ok_sn76496(false),
-	vdp(*this), region(region), plugged(false)
+	vdp(*this),
+#ifdef WITH_THREADS
+	screen_thread(NULL),
+#endif
+	snd_rs(NULL),
+	region(region), plugged(false)
 {
 	// Only one MD object is allowed to exist at once.
 	if (lock)
@@ -654,6 +671,7 @@ md::md(bool pal, char region):
   z80ram[0x10006] = 0x00;
   z80ram[0x10007] = 0x00;
 
+	misc_memory_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
@@ -759,6 +777,7 @@ cleanup:
 		YM2612Shutdown();
 	if (ok_sn76496)
 		(void)0;
+	resample_free(snd_rs);
 #ifdef WITH_MUSA
 	free(ctx_musa);
 #endif
@@ -776,6 +795,9 @@ cleanup:
 
 md::~md()
 {
+#ifdef WITH_THREADS
+	screen_thread_stop();
+#endif
 #ifdef WITH_VGMDUMP
 	vgm_dump_stop();
 #endif
@@ -805,6 +827,7 @@ md::~md()
 		YM2612Shutdown();
 	if (ok_sn76496)
 		(void)0;
+	resample_free(snd_rs);
 	ok=0;
 	memset(this, 0, sizeof(*this));
 	lock = false;
@@ -879,6 +902,7 @@ int md::plug_in(unsigned char *cart,int len)
       save_start = save_len = 0;
       saveram = NULL;
     }
+	misc_memory_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
@@ -930,6 +954,7 @@ int md::unplug()
   free(saveram);
   saveram = NULL;
   save_start = save_len = 0;
+	misc_memory_map();
 #ifdef WITH_MUSA
 	md_set_musa(1);
 	musa_memory_map();
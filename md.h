@@ -51,6 +51,7 @@ extern "C" {
 }
 
 #include "sn76496.h"
+#include "resample.h"
 #include "system.h"
 
 // Debugging macros and support functions. They look like this because C++98
@@ -113,7 +114,18 @@ extern "C" int test_ctv(unsigned char *dest, int len);
 extern "C" int blur_bitmap_16(unsigned char *dest, int len);
 extern "C" int blur_bitmap_15(unsigned char *dest, int len);
 
-struct bmap { unsigned char *data; int w,h; int pitch; int bpp; };
+// Only the (w - 16) x (h - 16) picture starting 8 lines and 16 bytes into
+// data is ever accessed, the guard band around it may not exist (e.g. when
+// data points into a screen surface).
+// If dirty isn't NULL, lines of the picture are only written when they
+// change, and dirty[line] is then set to 1. Clearing it is up to the owner.
+struct bmap {
+	unsigned char *data;
+	int w, h;
+	int pitch;
+	int bpp;
+	uint8_t *dirty;
+};
 
 // New struct, happily encapsulates all the sound info
 struct sndinfo {
@@ -123,6 +135,16 @@ struct sndinfo {
 
 int get_md_palette(unsigned char pal[256],unsigned char *cram);
 
+#ifdef WITH_THREADS
+// VDP changes recorded line by line by md_vdp::snap_line(), to be replayed
+// on another md_vdp by snap_apply().
+struct vdp_snap {
+	uint8_t *data;
+	size_t len; // bytes used
+	size_t size; // bytes allocated
+};
+#endif
+
 class md;
 class md_vdp
 {
@@ -145,23 +167,31 @@ private:
   int dma_len();
   int dma_addr();
   unsigned char dma_mem_read(int addr);
+  void dma_mem_copy(int src, int len);
+  void dma_vram_copy(int src, int len);
+  void dma_vram_fill(uint8_t hi, uint8_t lo, int len, bool word);
+  void vram_fill(unsigned int addr, unsigned int len, uint8_t hi, uint8_t lo);
   int putword(unsigned short d);
   int putbyte(unsigned char d);
   // Used by draw_scanline to render the different display components
   void draw_tile1(int which, int line, unsigned char *where);
   void draw_tile1_solid(int which, int line, unsigned char *where);
-  void draw_tile2(int which, int line, unsigned char *where);
-  void draw_tile2_solid(int which, int line, unsigned char *where);
-  void draw_tile3(int which, int line, unsigned char *where);
-  void draw_tile3_solid(int which, int line, unsigned char *where);
-  void draw_tile4(int which, int line, unsigned char *where);
-  void draw_tile4_solid(int which, int line, unsigned char *where);
-  void draw_window(int line, int front);
-  void draw_sprites(int line, bool front);
-  void draw_plane_back0(int line);
-  void draw_plane_back1(int line);
-  void draw_plane_front0(int line);
-  void draw_plane_front1(int line);
+  // Decoded VRAM, one byte per pixel for each 32-bit row of tile data,
+  // see tile_cache_update(). X-flipped tiles are read backwards.
+  uint8_t tile_cache[0x4000][8];
+  uint8_t tile_cache_flags[0x4000];
+  void tile_cache_update();
+  inline unsigned int tile_row(int which, int line);
+  void draw_window(int line);
+  template <bool front> void draw_sprites(int line);
+#ifdef WITH_DEBUG_VDP
+  void draw_sprites_boxing(int line, bool front);
+#endif
+  template <int plane> void draw_plane(int line);
+  template <typename pixel_t>
+  void convert_line(unsigned char *out, int start, int end);
+  void convert_line24(unsigned char *out, int start, int end);
+  void (md_vdp::*convert)(unsigned char *out, int start, int end);
   struct sprite_info {
     uint8_t* sprite; // sprite location
     uint32_t* tile; // array of tiles (th * tw)
@@ -175,19 +205,45 @@ private:
     unsigned int inter:1; // interlaced mode (8x16 tiles)
     unsigned int xflip:1; // X-flipped
     unsigned int yflip:1; // Y-flipped
+    unsigned int masking:1; // X position is 0
   };
   inline void get_sprite_info(struct sprite_info&, int);
-  inline void sprite_mask_add(uint8_t*, int, struct sprite_info&, int);
+  inline void sprite_order_update();
+  inline void sprite_lines_update();
   // Working variables for the above
   unsigned char sprite_order[0x101], *sprite_base;
-  uint8_t sprite_mask[512][512];
+  // sprite_order[] decoded, and its indices for each line in that order.
+  // Rebuilt with it or when reg[12] changes the geometry.
+  struct sprite_info sprite_infos[80];
+  uint8_t sprite_lines[(80 * 32)];
+  uint16_t sprite_lines_start[(0x100 + 1)];
+  int sprite_frame_end[2]; // first index over the frame limit, H32 and H40
+  uint8_t sprite_reg12;
+  // Opaque runs of low priority sprites on sprite_spans_line, see
+  // sprite_spans_update(). Up to 16 for each of the 80 sprites.
+  struct sprite_span {
+    int16_t x; // first dot
+    int16_t end; // last dot + 1
+    uint8_t index; // in sprite_order[]
+  };
+  struct sprite_span sprite_spans[(80 * 16)];
+  unsigned int sprite_spans_count;
+  int sprite_spans_line;
+  void sprite_spans_update(int line, int last, int dots);
+  inline bool sprite_spans_collide();
+  inline unsigned int sprite_spans_covered(int x, int index);
   int sprite_count;
   int masking_sprite_index_cache;
   int dots_cache;
   unsigned int Bpp;
-  unsigned int Bpp_times8;
   struct bmap *bmap;
+  // One byte per pixel for the line being drawn, a CRAM index and the
+  // priority bit. Pixels -8 to 335, dest points to pixel 0.
+  uint8_t line_buf[8 + 336];
   unsigned char *dest;
+  // Converted line, compared with the bmap before being copied when it
+  // tracks changes.
+  uint8_t line_out[(320 * 4)];
   md& belongs;
 public:
   md_vdp(md&);
@@ -200,15 +256,24 @@ public:
   int writebyte(unsigned char d);
 
   unsigned char *dirt; // Bitfield: what has changed VRAM/CRAM/VSRAM/Reg
+  unsigned char *status; // Sprite overflow and collision bits, belongs.coo5
   void reset();
 
   uint32_t highpal[64];
+  int highpal_bpp; // depth highpal[] was converted for
+  void highpal_update(int bpp);
   // Draw a scanline
   void sprite_masking_overflow(int line);
-  void sprite_mask_generate();
   void draw_scanline(struct bmap *bits, int line);
+  // Update status bits for a scanline that won't be drawn (frameskip)
+  void skip_scanline(int line);
   void draw_pixel(struct bmap *bits, int x, int y, uint32_t rgb);
   void write_reg(uint8_t addr, uint8_t data);
+#ifdef WITH_THREADS
+  uint8_t snap_reg[0x20]; // registers as of the last snap_line()
+  int snap_line(struct vdp_snap *snap, int line);
+  int snap_apply(const uint8_t **data);
+#endif
 };
 
 /* Generic structures for dumping and restoring M68K and Z80 states. */
@@ -466,6 +531,14 @@ private:
   unsigned char  calculate_coo8();
   unsigned char  calculate_coo9();
   int may_want_to_get_pic(struct bmap *bm,unsigned char retpal[256],int mark);
+#ifdef WITH_THREADS
+	// Render threads (dgen_screen_thread), see mdfr.cpp
+	struct md_screen_thread *screen_thread;
+	bool screen_thread_start();
+	void screen_thread_stop();
+	void screen_thread_config();
+	void screen_thread_frame(struct bmap *bm, unsigned int lines);
+#endif
   int may_want_to_get_sound(struct sndinfo *sndi);
 
 	// Horizontal counter table
@@ -505,11 +578,53 @@ private:
 	void dac_submit(uint8_t d);
 	void dac_enable(uint8_t d);
 
+	struct resample *snd_rs; // NULL unless chips run at their own rate
+	unsigned int snd_rate; // rate sound chips are running at
+
   uint8_t m68k_ROM_read(uint32_t a);
   uint8_t m68k_IO_read(uint32_t a);
   uint8_t m68k_VDP_read(uint32_t a);
   void m68k_ROM_write(uint32_t, uint8_t);
   void m68k_IO_write(uint32_t, uint8_t);
+	uint8_t m68k_empty_read(uint32_t a);
+	void m68k_empty_write(uint32_t a, uint8_t d);
+#ifdef WITH_PICO
+	uint8_t m68k_PICO_read(uint32_t a);
+#endif
+	uint8_t m68k_Z80_read(uint32_t a);
+	uint8_t m68k_Z80_read_nobus(uint32_t a);
+	void m68k_Z80_write(uint32_t a, uint8_t d);
+	void m68k_Z80_write_nobus(uint32_t a, uint8_t d);
+	void m68k_Z80_writeword(uint32_t a, uint16_t d);
+	uint16_t m68k_ROM_readword(uint32_t a);
+	void m68k_ROM_writeword(uint32_t a, uint16_t d);
+	uint16_t m68k_IO_readword(uint32_t a);
+	void m68k_VDP_write(uint32_t a, uint8_t d);
+	uint16_t m68k_VDP_readword(uint32_t a);
+	void m68k_VDP_writeword(uint32_t a, uint16_t d);
+
+	// Page table used by misc_*(), one entry per 64KB of M68K address
+	// space. Plain memory pages are accessed through r and w (offsets
+	// within the page are XORed with swab), NULL pointers mean the
+	// handlers must be called instead. Aligned words are loaded and
+	// stored natively from those pages, swab also tells whether they are
+	// stored little-endian (1) or big-endian (0). Word handlers are
+	// optional, two byte accesses are made when they're NULL.
+	struct bus_page {
+		uint8_t *r;
+		uint8_t *w;
+		unsigned int swab;
+		uint8_t (md::*readbyte)(uint32_t a);
+		void (md::*writebyte)(uint32_t a, uint8_t d);
+		uint16_t (md::*readword)(uint32_t a);
+		void (md::*writeword)(uint32_t a, uint16_t d);
+	};
+	struct bus_page bus_map[0x100];
+	friend class md_vdp; // DMA reads directly from bus_map pages
+	// Rebuild bus_map, must be called whenever the ROM or save RAM state
+	// changes. misc_memory_map_z80() is enough for BUSREQ changes.
+	void misc_memory_map();
+	void misc_memory_map_z80();
 
 
 public:
@@ -578,6 +693,8 @@ public:
 	void misc_writebyte(uint32_t a, uint8_t d);
 	uint16_t misc_readword(uint32_t a);
 	void misc_writeword(uint32_t a, uint16_t d);
+	uint32_t misc_readlong(uint32_t a);
+	void misc_writelong(uint32_t a, uint32_t d);
 
 	void z80_init();
 	void z80_reset();
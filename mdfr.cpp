@@ -9,6 +9,9 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 #ifdef HAVE_MEMCPY_H
 #include "memcpy.h"
 #endif
@@ -548,6 +551,7 @@ void md::m68k_busreq_request()
 	if (z80_st_busreq)
 		return;
 	z80_st_busreq = 1;
+	misc_memory_map_z80();
 	if (z80_st_reset)
 		return;
 	z80_sync(0);
@@ -559,6 +563,7 @@ void md::m68k_busreq_cancel()
 	if (!z80_st_busreq)
 		return;
 	z80_st_busreq = 0;
+	misc_memory_map_z80();
 	z80_sync(1);
 }
 
@@ -905,6 +910,9 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 	if (debug_trap)
 		return 0;
 #endif
+#ifdef WITH_THREADS
+	screen_thread_config();
+#endif
 #ifdef WITH_DEBUG_VDP
 	/*
 	 * If the user is disabling planes for debugging, then we
@@ -913,8 +921,13 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 	 */
 	if ((bm != NULL) &&
 	    (dgen_vdp_hide_plane_b | dgen_vdp_hide_plane_a |
-	     dgen_vdp_hide_plane_w | dgen_vdp_hide_sprites))
-		memset(bm->data, 0, (bm->pitch * bm->h));
+	     dgen_vdp_hide_plane_w | dgen_vdp_hide_sprites)) {
+		int y;
+
+		for (y = 8; (y < (bm->h - 8)); ++y)
+			memset((bm->data + (bm->pitch * y) + 16), 0,
+			       ((bm->w - 16) * BITS_TO_BYTES(bm->bpp)));
+	}
 #endif
 	md_set(1);
 	// Reset odometers
@@ -967,6 +980,11 @@ int md::one_frame(struct bmap *bm, unsigned char retpal[256],
 		m68k_run();
 		z80_run();
 	}
+#ifdef WITH_THREADS
+	// Get the previous frame, let the render thread draw this one
+	if ((screen_thread != NULL) && (bm != NULL))
+		screen_thread_frame(bm, vblank);
+#endif
 	// Now we're in vblank, more special things happen :)
 	// The following was roughly adapted from Genplus GX
 	// Enable v-blank
@@ -1113,16 +1131,272 @@ uint8_t md::calculate_coo9()
 	return hc_table[id][0];
 }
 
+#ifdef WITH_THREADS
+
+// *************************************
+//       Render threads
+// *************************************
+
+// The emulation thread records VDP changes for each displayed line into
+// snap[rec] instead of drawing them. At the start of vblank the render
+// threads get them and draw into bm, which is copied out one frame later.
+// The frame is split into bands of lines, one for each thread. They all
+// replay every line on their own VDP, so that they keep the same state
+// from one frame to the next, but only draw their own band. Raster effects
+// are kept since every line is drawn with the VDP state it had at that
+// point.
+struct md_screen_worker {
+	pthread_t thread;
+	struct md_screen_thread *st;
+	md_vdp *vdp; // copy of the VDP, only used by this thread
+	int first; // first line of the band
+	int end; // last line + 1
+	unsigned char coo5; // status bits set by vdp, not used
+};
+
+struct md_screen_thread {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // frame changed or quit
+	pthread_cond_t done; // busy reached 0
+	struct vdp_snap snap[2];
+	unsigned int rec; // snap[] being recorded, the other one is drawn
+	struct bmap bm;
+	unsigned int frame; // incremented when a frame is handed over
+	unsigned int busy; // number of workers drawing snap[!rec]
+	bool ready; // bm holds a frame, complete once busy is 0
+	bool quit;
+	unsigned int workers;
+	struct md_screen_worker *worker;
+};
+
+static void *screen_thread_main(void *arg)
+{
+	struct md_screen_worker *w = (struct md_screen_worker *)arg;
+	struct md_screen_thread *st = w->st;
+	unsigned int frame = 0;
+
+	pthread_mutex_lock(&st->mutex);
+	while (1) {
+		const uint8_t *p;
+		const uint8_t *end;
+
+		while ((st->frame == frame) && (!st->quit))
+			pthread_cond_wait(&st->cond, &st->mutex);
+		if (st->quit)
+			break;
+		frame = st->frame;
+		p = st->snap[(st->rec ^ 1)].data;
+		end = (p + st->snap[(st->rec ^ 1)].len);
+		pthread_mutex_unlock(&st->mutex);
+		w->vdp->sprite_overflow_line = INT_MIN;
+		while (p != end) {
+			int line = w->vdp->snap_apply(&p);
+
+			if ((line >= w->first) && (line < w->end))
+				w->vdp->draw_scanline(&st->bm, line);
+			// Sprite masking depends on the previous line.
+			else if (line == (w->first - 1))
+				w->vdp->skip_scanline(line);
+		}
+		pthread_mutex_lock(&st->mutex);
+		if (--st->busy == 0)
+			pthread_cond_signal(&st->done);
+	}
+	pthread_mutex_unlock(&st->mutex);
+	return NULL;
+}
+
+// Number of render threads wanted, dgen_screen_bands or one per CPU.
+static unsigned int screen_thread_bands()
+{
+	long bands = dgen_screen_bands;
+
+	if (bands <= 0)
+		bands = sysconf(_SC_NPROCESSORS_ONLN);
+	if (bands < 1)
+		bands = 1;
+	else if (bands > 16)
+		bands = 16;
+	return bands;
+}
+
+bool md::screen_thread_start()
+{
+	struct md_screen_thread *st;
+	unsigned int workers = screen_thread_bands();
+	unsigned int i;
+
+	if ((st = (struct md_screen_thread *)calloc(1, sizeof(*st))) == NULL)
+		return false;
+	st->worker = (struct md_screen_worker *)
+		calloc(workers, sizeof(*st->worker));
+	if (st->worker == NULL)
+		goto error_worker;
+	if (pthread_mutex_init(&st->mutex, NULL))
+		goto error_mutex;
+	if (pthread_cond_init(&st->cond, NULL))
+		goto error_cond;
+	if (pthread_cond_init(&st->done, NULL))
+		goto error_done;
+	for (i = 0; (i != workers); ++i) {
+		struct md_screen_worker *w = &st->worker[i];
+
+		w->st = st;
+		if ((w->vdp = new md_vdp(*this)) == NULL)
+			break;
+		w->vdp->status = &w->coo5;
+		if (pthread_create(&w->thread, NULL, screen_thread_main, w)) {
+			delete w->vdp;
+			break;
+		}
+		++st->workers;
+	}
+	if (st->workers != workers) {
+		screen_thread = st;
+		screen_thread_stop();
+		return false;
+	}
+	// All VDPs start over, everything gets recorded once.
+	memset(vdp.snap_reg, 0, sizeof(vdp.snap_reg));
+	memset(vdp.dirt, 0xff, 0x35);
+	screen_thread = st;
+	return true;
+error_done:
+	pthread_cond_destroy(&st->cond);
+error_cond:
+	pthread_mutex_destroy(&st->mutex);
+error_mutex:
+	free(st->worker);
+error_worker:
+	free(st);
+	return false;
+}
+
+void md::screen_thread_stop()
+{
+	struct md_screen_thread *st = screen_thread;
+	unsigned int i;
+
+	if (st == NULL)
+		return;
+	pthread_mutex_lock(&st->mutex);
+	st->quit = true;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+	for (i = 0; (i != st->workers); ++i) {
+		pthread_join(st->worker[i].thread, NULL);
+		delete st->worker[i].vdp;
+	}
+	pthread_cond_destroy(&st->done);
+	pthread_cond_destroy(&st->cond);
+	pthread_mutex_destroy(&st->mutex);
+	free(st->worker);
+	free(st->snap[0].data);
+	free(st->snap[1].data);
+	free(st->bm.data);
+	free(st);
+	screen_thread = NULL;
+	// snap_line() consumed dirt the tile cache still needs.
+	memset(vdp.dirt, 0xff, 0x35);
+}
+
+// Start, stop or restart render threads according to dgen_screen_thread
+// and dgen_screen_bands.
+void md::screen_thread_config()
+{
+	if ((screen_thread != NULL) &&
+	    ((!dgen_screen_thread) ||
+	     (screen_thread->workers != screen_thread_bands())))
+		screen_thread_stop();
+	if ((dgen_screen_thread) && (screen_thread == NULL) &&
+	    (!screen_thread_start()))
+		dgen_screen_thread = 0;
+}
+
+// Called at the start of vblank, copy the previous frame to bm and hand
+// over the current one, "lines" long. The back buffer has the same
+// geometry as bm, guard band included.
+void md::screen_thread_frame(struct bmap *bm, unsigned int lines)
+{
+	struct md_screen_thread *st = screen_thread;
+	size_t size = (bm->pitch * bm->h);
+	unsigned int i;
+
+	pthread_mutex_lock(&st->mutex);
+	while (st->busy)
+		pthread_cond_wait(&st->done, &st->mutex);
+	if ((st->bm.w != bm->w) || (st->bm.h != bm->h) ||
+	    (st->bm.pitch != bm->pitch) || (st->bm.bpp != bm->bpp)) {
+		uint8_t *data = (uint8_t *)realloc(st->bm.data, size);
+
+		if (data == NULL) {
+			pthread_mutex_unlock(&st->mutex);
+			screen_thread_stop();
+			dgen_screen_thread = 0;
+			return;
+		}
+		st->bm = *bm;
+		st->bm.data = data;
+		st->bm.dirty = NULL;
+		st->ready = false;
+	}
+	else if (st->ready) {
+		size_t width = ((bm->w - 16) * BITS_TO_BYTES(bm->bpp));
+		int y;
+
+		for (y = 8; (y < (bm->h - 8)); ++y) {
+			uint8_t *dst = (bm->data + (bm->pitch * y) + 16);
+			uint8_t *src = (st->bm.data + (st->bm.pitch * y) + 16);
+
+			if (bm->dirty == NULL)
+				memcpy(dst, src, width);
+			else if (memcmp(dst, src, width)) {
+				memcpy(dst, src, width);
+				bm->dirty[(y - 8)] = 1;
+			}
+		}
+	}
+	for (i = 0; (i != st->workers); ++i) {
+		st->worker[i].first = ((lines * i) / st->workers);
+		st->worker[i].end = ((lines * (i + 1)) / st->workers);
+	}
+	st->rec ^= 1;
+	st->snap[st->rec].len = 0;
+	st->busy = st->workers;
+	st->ready = true;
+	++st->frame;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+}
+
+#endif // WITH_THREADS
+
 // *************************************
 //       May want to get pic or sound
 // *************************************
 
 inline int md::may_want_to_get_pic(struct bmap *bm,unsigned char retpal[256],int/*mark*/)
 {
-  if (bm==NULL) return 0;
-
   if (ras>=0 && (unsigned int)ras<vblank())
-    vdp.draw_scanline(bm, ras);
+    {
+      // Skipped frame, only keep the VDP status up to date
+      if (bm==NULL)
+        {
+          vdp.skip_scanline(ras);
+          return 0;
+        }
+#ifdef WITH_THREADS
+      // Drawn later by the render thread, record what it needs to know
+      if (screen_thread != NULL)
+        {
+          vdp.skip_scanline(ras);
+          vdp.snap_line(&screen_thread->snap[screen_thread->rec], ras);
+        }
+      else
+#endif
+      vdp.draw_scanline(bm, ras);
+    }
+  if (bm==NULL) return 0;
   if(retpal && ras == 100) get_md_palette(retpal, vdp.cram);
   return 0;
 }
@@ -1130,16 +1404,28 @@ inline int md::may_want_to_get_pic(struct bmap *bm,unsigned char retpal[256],int
 int md::may_want_to_get_sound(struct sndinfo *sndi)
 {
   extern intptr_t dgen_volume;
+  int16_t *lr = sndi->lr;
   unsigned int i, len = sndi->len;
 
+	// When chips run at their own rate, they fill the resampler input
+	// with however many samples it needs for sndi->len.
+	if (snd_rs != NULL) {
+		lr = resample_in(snd_rs, sndi->len, &len);
+		if (lr == NULL) {
+			memset(sndi->lr, 0, (sizeof(sndi->lr[0]) * 2 * sndi->len));
+			dac_len = 0;
+			return 0;
+		}
+	}
+
   // Get the PSG
-  SN76496Update_16_2(0, sndi->lr, len);
+  SN76496Update_16_2(0, lr, len);
 
 	if (dac_len) {
-		unsigned int ratio = ((sndi->len << 10) / elemof(dac_data));
+		unsigned int ratio = ((len << 10) / elemof(dac_data));
 
 		// Stretch the DAC to fit the real length.
-		for (i = 0; (i != sndi->len); ++i) {
+		for (i = 0; (i != len); ++i) {
 			unsigned int index = ((i << 10) / ratio);
 			uint16_t data;
 
@@ -1148,8 +1434,8 @@ int md::may_want_to_get_sound(struct sndinfo *sndi)
 			else
 				data = dac_data[index];
 			data = ((data - 0x80) << 6);
-			sndi->lr[i << 1] += data;
-			sndi->lr[(i << 1) ^ 1] += data;
+			lr[i << 1] += data;
+			lr[(i << 1) ^ 1] += data;
 		}
 		// Clear the DAC for next frame.
 		dac_len = 0;
@@ -1159,11 +1445,13 @@ int md::may_want_to_get_sound(struct sndinfo *sndi)
 	}
 
   // Add in the stereo FM buffer
-  YM2612UpdateOne(0, sndi->lr, len, dgen_volume, 1);
+  YM2612UpdateOne(0, lr, len, dgen_volume, 1);
   if (dgen_mjazz) {
-    YM2612UpdateOne(1, sndi->lr, len, dgen_volume, 0);
-    YM2612UpdateOne(2, sndi->lr, len, dgen_volume, 0);
+    YM2612UpdateOne(1, lr, len, dgen_volume, 0);
+    YM2612UpdateOne(2, lr, len, dgen_volume, 0);
   }
+	if (snd_rs != NULL)
+		resample_out(snd_rs, sndi->lr, sndi->len);
   return 0;
 }
 
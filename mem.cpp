@@ -8,6 +8,29 @@
 #include "md.h"
 #include "mem.h"
 
+/*
+ * Host-endian words within bus_map pages and save RAM. Pages are 64KB
+ * aligned and 68K word accesses are always even, so these are plain
+ * aligned halfword loads and stores, even on ARMv5.
+ */
+#ifdef __GNUC__
+typedef uint16_t __attribute__((__may_alias__)) bus16_t;
+#else
+typedef uint16_t bus16_t;
+#endif
+
+static inline uint16_t bus_load16(const uint8_t *p, unsigned int swab)
+{
+	uint16_t v = *(const bus16_t *)p;
+
+	return (swab ? le2h16(v) : be2h16(v));
+}
+
+static inline void bus_store16(uint8_t *p, unsigned int swab, uint16_t v)
+{
+	*(bus16_t *)p = (swab ? h2le16(v) : h2be16(v));
+}
+
 /**
  * Read one byte from the memory space.
  * @param a Address to read
@@ -108,14 +131,50 @@ uint8_t md::m68k_ROM_read(uint32_t a)
 	return 0;
 }
 
+uint16_t md::m68k_ROM_readword(uint32_t a)
+{
+	/* save RAM, always stored byteswapped */
+	if ((save_active) && (save_len) && ((a & 1) == 0) &&
+	    (a >= save_start) && ((a - save_start) < save_len))
+		return bus_load16(&saveram[(a - save_start)], 1);
+	/* ROM outside of direct pages, odd addresses */
+	return ((m68k_ROM_read(a) << 8) | m68k_ROM_read(a + 1));
+}
+
+/* 0xa00000-0xa0ffff: Z80 area, while the M68K holds the bus */
+uint8_t md::m68k_Z80_read(uint32_t a)
+{
+	return z80_read(a & 0xffff);
+}
+
+/* 0xa00000-0xa0ffff: Z80 area, only YM2612 and above are reachable */
+uint8_t md::m68k_Z80_read_nobus(uint32_t a)
+{
+	if (a < 0xa04000)
+		return 0;
+	return z80_read(a & 0xffff);
+}
+
+void md::m68k_Z80_write(uint32_t a, uint8_t d)
+{
+	z80_write((a & 0xffff), d);
+}
+
+void md::m68k_Z80_write_nobus(uint32_t a, uint8_t d)
+{
+	if (a < 0xa04000)
+		return;
+	z80_write((a & 0xffff), d);
+}
+
+/* Only the high byte of words reaches the Z80 */
+void md::m68k_Z80_writeword(uint32_t a, uint16_t d)
+{
+	misc_writebyte(a, (d >> 8));
+}
+
 uint8_t md::m68k_IO_read(uint32_t a)
 {
-	/* Z80 */
-	if (a < 0xa10000) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return 0;
-		return z80_read(a & 0xffff);
-	}
 	/* version */
 	if (a == 0xa10000)
 		return 0;
@@ -233,22 +292,11 @@ uint8_t md::m68k_VDP_read(uint32_t a)
 	return 0; /* invalid address */
 }
 
-/**
- * Read a byte from the m68Ks ram.
- * @param a Address to read.
- */
-uint8_t md::misc_readbyte(uint32_t a)
-{
-	/* clip to 24-bit */
-	a &= 0x00ffffff;
-	/* 0x000000-0x7fffff: ROM */
-	if (a <= M68K_ROM_END) {
-		return m68k_ROM_read(a);
-	}
 #ifdef WITH_PICO
+uint8_t md::m68k_PICO_read(uint32_t a)
+{
 	/* 0x800000-0x80001f: Sega Pico I/O area */
-	if ((pico_enabled) &&
-	    ((a >= 0x800000) && (a <= 0x80001f))) {
+	if (a <= 0x80001f) {
 		a &= 0x1f;
 		switch(a) {
 		case 1: // Version register
@@ -274,32 +322,36 @@ uint8_t md::misc_readbyte(uint32_t a)
 		}
 	}
 	/* 0x800020-0xafffff: Sega Pico empty area */
-	if ((pico_enabled) &&
-	    (a <= M68K_IO_END))
-		return 0;
+	return 0;
+}
 #endif
-	/* 0x800000-0x9fffff: empty area */
-	if (a <= M68K_EMPTY1_END) {
-		/*
-		 * http://cgfm2.emuviews.com/txt/gen-hw.txt
-		 * see section 1 point 3 for what these addresses do.
-		 */
-		return 0;
-	}
-	/* 0xa00000-0xafffff: system I/O and control */
-	if (a <= M68K_IO_END) {
-		return m68k_IO_read(a);
-	}
-	/* 0xb00000-0xbfffff: empty area */
-	if (a <= M68K_EMPTY2_END)
-		return 0;
-	/* 0xc00000-0xdfffff: VDP/PSG */
-	if (a <= M68K_VDP_END) {
-		return m68k_VDP_read(a);
-	}
-	/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
-	/* 0xff0000-0xffffff: RAM */
-	return ram[((a ^ 1) & 0xffff)];
+
+uint8_t md::m68k_empty_read(uint32_t a)
+{
+	/*
+	 * http://cgfm2.emuviews.com/txt/gen-hw.txt
+	 * see section 1 point 3 for what these addresses do.
+	 */
+	(void)a;
+	return 0;
+}
+
+/**
+ * Read a byte from the m68Ks ram.
+ * @param a Address to read.
+ */
+uint8_t md::misc_readbyte(uint32_t a)
+{
+	const struct bus_page *page;
+
+	/* clip to 24-bit */
+	a &= 0x00ffffff;
+	page = &bus_map[(a >> 16)];
+	/* ROM, RAM */
+	if (page->r != NULL)
+		return page->r[((a & 0xffff) ^ page->swab)];
+	/* everything else */
+	return (this->*page->readbyte)(a);
 }
 
 void md::m68k_ROM_write(uint32_t a, uint8_t d)
@@ -315,15 +367,20 @@ void md::m68k_ROM_write(uint32_t a, uint8_t d)
 #endif
 }
 
-void md::m68k_IO_write(uint32_t a, uint8_t d)
+void md::m68k_ROM_writeword(uint32_t a, uint16_t d)
 {
-	/* Z80 */
-	if (a < 0xa10000) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return;
-		z80_write((a & 0xffff), d);
+	/* save RAM */
+	if ((!save_prot) && (save_len) && ((a & 1) == 0) &&
+	    (a >= save_start) && ((a - save_start) < save_len)) {
+		bus_store16(&saveram[(a - save_start)], 1, d);
 		return;
 	}
+	m68k_ROM_write(a, (d >> 8));
+	m68k_ROM_write((a + 1), (d & 0xff));
+}
+
+void md::m68k_IO_write(uint32_t a, uint8_t d)
+{
 	if (a == 0xa11100) {
 		/* Z80 BUSREQ */
 		if (d & 0x01)
@@ -390,11 +447,30 @@ void md::m68k_IO_write(uint32_t a, uint8_t d)
 		*/
 		save_active = (d & 1);
 		save_prot = (d & 2);
+		misc_memory_map();
 		return;
 	}
 	return;
 }
 
+void md::m68k_empty_write(uint32_t a, uint8_t d)
+{
+	(void)a;
+	(void)d;
+}
+
+void md::m68k_VDP_write(uint32_t a, uint8_t d)
+{
+	a &= 0xe700ff;
+	if (a < 0xc00008) {
+		m68k_VDP_writeword(a, (d | (d << 8)));
+		return;
+	}
+	/* PSG */
+	if (a == 0xc00011)
+		mysn_write(d);
+}
+
 /**
  * write a byte to the m68Ks ram.
  * @param a Address to write.
@@ -402,42 +478,88 @@ void md::m68k_IO_write(uint32_t a, uint8_t d)
  */
 void md::misc_writebyte(uint32_t a, uint8_t d)
 {
+	const struct bus_page *page;
+
 	/* clip to 24-bit */
 	a &= 0x00ffffff;
-	/* 0x000000-0x7fffff: ROM */
-	if (a <= M68K_ROM_END) {
-		m68k_ROM_write(a, d);
+	page = &bus_map[(a >> 16)];
+	/* RAM */
+	if (page->w != NULL) {
+		page->w[((a & 0xffff) ^ page->swab)] = d;
 		return;
 	}
-	/* 0x800000-0x9fffff: empty area */
-	if (a <= M68K_EMPTY1_END)
-		return;
-	/* 0xa00000-0xafffff: system I/O and control */
-	if (a <= M68K_IO_END) {
-		m68k_IO_write(a, d);
-		return;
+	/* everything else */
+	(this->*page->writebyte)(a, d);
+}
+
+
+uint16_t md::m68k_IO_readword(uint32_t a)
+{
+	/* BUSREQ */
+	if ((a & 0xffff00) == 0xa11100)
+		return ((!z80_st_busreq << 8) | (m68k_read_pc() & 0xfeff));
+	/* RESET */
+	if ((a & 0xffff00) == 0xa11200)
+		return m68k_read_pc();
+	return ((misc_readbyte(a) << 8) | misc_readbyte(a + 1));
+}
+
+uint16_t md::m68k_VDP_readword(uint32_t a)
+{
+	a &= 0xe700ff;
+	if (a < 0xc00004) {
+		if (a & 0x01)
+			return 0;
+		vdp.cmd_pending = false;
+		return vdp.readword();
+	}
+	if (a < 0xc00008) {
+		if (a & 0x01)
+			return 0;
+		return (((coo4 & 0xff) << 8) | (coo5 & 0xff));
+	}
+	if (a == 0xc00008) {
+		if (a & 0x01)
+			return 0;
+		return ((calculate_coo8() << 8) |
+			(calculate_coo9() & 0xff));
 	}
-	/* 0xb00000-0xbfffff: empty area */
-	if (a <= M68K_EMPTY2_END)
+	return ((m68k_VDP_read(a) << 8) | m68k_VDP_read(a + 1));
+}
+
+void md::m68k_VDP_writeword(uint32_t a, uint16_t d)
+{
+	a &= 0xe700ff;
+	if (a < 0xc00004) {
+		if (a & 0x01)
+			return;
+		vdp.writeword(d);
+		vdp.cmd_pending = false;
 		return;
-	/* 0xc00000-0xdfffff: VDP/PSG */
-	if (a < M68K_VDP_END) {
-		a &= 0xe700ff;
-		if (a < 0xc00008) {
-			misc_writeword(a, (d | (d << 8)));
+	}
+	if (a < 0xc00008) {
+		if (a & 0x01)
+			return;
+		/* second half of a command */
+		if (vdp.cmd_pending) {
+			vdp.command(d);
 			return;
 		}
-		/* PSG */
-		if (a == 0xc00011)
-			mysn_write(d);
+		/* register write */
+		if ((d & 0xc000) == 0x8000) {
+			uint8_t addr = ((d >> 8) & 0x1f);
+			vdp.write_reg(addr, d);
+			return;
+		}
+		/* first half of a command */
+		vdp.command(d);
+		vdp.cmd_pending = true;
 		return;
 	}
-	/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
-	/* 0xff0000-0xffffff: RAM */
-	ram[((a ^ 1) & 0xffff)] = d;
+	m68k_VDP_write(a, (d >> 8));
+	m68k_VDP_write((a + 1), (d & 0xff));
 }
 
-
 /**
  * Read a word from the m68k memory.
  * There are quirks with word wide reads see section 1.2 of
@@ -447,40 +569,17 @@ void md::misc_writebyte(uint32_t a, uint8_t d)
  */
 uint16_t md::misc_readword(uint32_t a)
 {
-	uint16_t ret;
+	const struct bus_page *page;
 
 	a &= 0x00ffffff;
-	/* BUSREQ */
-	if ((a & 0xffff00) == 0xa11100)
-		return ((!z80_st_busreq << 8) | (m68k_read_pc() & 0xfeff));
-	/* RESET */
-	if ((a & 0xffff00) == 0xa11200)
-		return m68k_read_pc();
-	/* VDP */
-	if ((a >= 0xc00000) && (a < 0xe00000)) {
-		a &= 0xe700ff;
-		if (a < 0xc00004) {
-			if (a & 0x01)
-				return 0;
-			vdp.cmd_pending = false;
-			return vdp.readword();
-		}
-		if (a < 0xc00008) {
-			if (a & 0x01)
-				return 0;
-			return (((coo4 & 0xff) << 8) | (coo5 & 0xff));
-		}
-		if (a == 0xc00008) {
-			if (a & 0x01)
-				return 0;
-			return ((calculate_coo8() << 8) |
-				(calculate_coo9() & 0xff));
-		}
-	}
+	page = &bus_map[(a >> 16)];
+	/* ROM, RAM */
+	if ((page->r != NULL) && ((a & 1) == 0))
+		return bus_load16(&page->r[(a & 0xffff)], page->swab);
+	if (page->readword != NULL)
+		return (this->*page->readword)(a);
 	/* else pass onto readbyte */
-	ret = (misc_readbyte(a) << 8);
-	ret |= misc_readbyte(a + 1);
-	return ret;
+	return ((misc_readbyte(a) << 8) | misc_readbyte(a + 1));
 }
 
 /**
@@ -490,55 +589,174 @@ uint16_t md::misc_readword(uint32_t a)
  */
 void md::misc_writeword(uint32_t a, uint16_t d)
 {
+	const struct bus_page *page;
+
 	a &= 0x00ffffff;
-	/* Z80 */
-	if ((a >= 0xa00000) && (a < 0xa10000)) {
-		if ((!z80_st_busreq) && (a < 0xa04000))
-			return;
-		z80_write((a & 0xffff), (d >> 8));
+	page = &bus_map[(a >> 16)];
+	/* RAM */
+	if ((page->w != NULL) && ((a & 1) == 0)) {
+		bus_store16(&page->w[(a & 0xffff)], page->swab, d);
 		return;
 	}
-	/* BUSREQ and RESET */
-	if ((a == 0xa11100) ||
-	    (a == 0xa11200)) {
-		misc_writebyte(a, (d >> 8));
+	if (page->writeword != NULL) {
+		(this->*page->writeword)(a, d);
 		return;
 	}
-	/* VDP */
-	if ((a >= 0xc00000) && (a < 0xe00000)) {
-		a &= 0xe700ff;
-		if (a < 0xc00004) {
-			if (a & 0x01)
-				return;
-			vdp.writeword(d);
-			vdp.cmd_pending = false;
-			return;
-		}
-		if (a < 0xc00008) {
-			if (a & 0x01)
-				return;
-			/* second half of a command */
-			if (vdp.cmd_pending) {
-				vdp.command(d);
-				return;
-			}
-			/* register write */
-			if ((d & 0xc000) == 0x8000) {
-				uint8_t addr = ((d >> 8) & 0x1f);
-				vdp.write_reg(addr, d);
-				return;
-			}
-			/* first half of a command */
-			vdp.command(d);
-			vdp.cmd_pending = true;
-			return;
-		}
-	}
 	/* else pass onto writebyte */
 	misc_writebyte(a, (d >> 8));
 	misc_writebyte((a + 1), (d & 0xff));
 }
 
+/**
+ * Read a long word from the m68k memory.
+ * Only one page lookup is made unless it crosses a page boundary.
+ * @param a Address to read
+ * @return long word from memory.
+ */
+uint32_t md::misc_readlong(uint32_t a)
+{
+	const struct bus_page *page;
+
+	a &= 0x00ffffff;
+	page = &bus_map[(a >> 16)];
+	/* ROM, RAM */
+	if ((page->r != NULL) && ((a & 1) == 0) && ((a & 0xffff) != 0xfffe)) {
+		const uint8_t *r = &page->r[(a & 0xffff)];
+
+		return ((bus_load16(r, page->swab) << 16) |
+			bus_load16((r + 2), page->swab));
+	}
+	if (((a & 0xffff) < 0xfffe) && (page->readword != NULL))
+		return (((this->*page->readword)(a) << 16) |
+			(this->*page->readword)(a + 2));
+	/* else pass onto readword */
+	return ((misc_readword(a) << 16) | misc_readword(a + 2));
+}
+
+/**
+ * Write a long word to m68k memory.
+ * @param a Address to write to.
+ * @param d Data to write.
+ */
+void md::misc_writelong(uint32_t a, uint32_t d)
+{
+	const struct bus_page *page;
+
+	a &= 0x00ffffff;
+	page = &bus_map[(a >> 16)];
+	/* RAM */
+	if ((page->w != NULL) && ((a & 1) == 0) && ((a & 0xffff) != 0xfffe)) {
+		uint8_t *w = &page->w[(a & 0xffff)];
+
+		bus_store16(w, page->swab, (d >> 16));
+		bus_store16((w + 2), page->swab, d);
+		return;
+	}
+	if (((a & 0xffff) < 0xfffe) && (page->writeword != NULL)) {
+		(this->*page->writeword)(a, (d >> 16));
+		(this->*page->writeword)((a + 2), d);
+		return;
+	}
+	/* else pass onto writeword */
+	misc_writeword(a, (d >> 16));
+	misc_writeword((a + 2), d);
+}
+
+/**
+ * Build the misc_*() page table.
+ */
+void md::misc_memory_map()
+{
+	unsigned int i;
+
+	for (i = 0; (i != elemof(bus_map)); ++i) {
+		struct bus_page *page = &bus_map[i];
+		uint32_t a = (i << 16);
+
+		page->r = NULL;
+		page->w = NULL;
+		page->swab = 0;
+		page->readword = NULL;
+		page->writeword = NULL;
+		/* 0x000000-0x7fffff: ROM */
+		if (a <= M68K_ROM_END) {
+			page->readbyte = &md::m68k_ROM_read;
+			page->writebyte = &md::m68k_ROM_write;
+			page->readword = &md::m68k_ROM_readword;
+			page->writeword = &md::m68k_ROM_writeword;
+			/* Pages entirely made of ROM can be read directly. */
+			if (((a + 0x10000) > romlen) ||
+			    ((save_active) && (save_len) &&
+			     ((a + 0x10000) > save_start) &&
+			     (a < (save_start + save_len))))
+				continue;
+			page->r = &rom[a];
+#ifdef ROM_BYTESWAP
+			page->swab = 1;
+#endif
+			continue;
+		}
+		/* 0x800000-0x9fffff: empty area */
+		/* 0xb00000-0xbfffff: empty area */
+		page->readbyte = &md::m68k_empty_read;
+		page->writebyte = &md::m68k_empty_write;
+		if (a <= M68K_EMPTY1_END)
+			;
+		/* 0xa00000-0xa0ffff: Z80, see misc_memory_map_z80() */
+		else if (a < 0xa10000)
+			page->writeword = &md::m68k_Z80_writeword;
+		/* 0xa10000-0xafffff: system I/O and control */
+		else if (a <= M68K_IO_END) {
+			page->readbyte = &md::m68k_IO_read;
+			page->writebyte = &md::m68k_IO_write;
+			page->readword = &md::m68k_IO_readword;
+		}
+		else if (a <= M68K_EMPTY2_END)
+			;
+		/* 0xc00000-0xdfffff: VDP/PSG */
+		else if (a <= M68K_VDP_END) {
+			page->readbyte = &md::m68k_VDP_read;
+			page->writebyte = &md::m68k_VDP_write;
+			page->readword = &md::m68k_VDP_readword;
+			page->writeword = &md::m68k_VDP_writeword;
+		}
+		/* 0xe00000-0xfeffff: invalid addresses, mirror RAM */
+		/* 0xff0000-0xffffff: RAM */
+		else {
+			page->r = ram;
+			page->w = ram;
+			page->swab = 1;
+		}
+#ifdef WITH_PICO
+		/* 0x800000-0xafffff: Sega Pico I/O and empty area */
+		if ((pico_enabled) && (a <= M68K_IO_END))
+			page->readbyte = &md::m68k_PICO_read;
+#endif
+	}
+	misc_memory_map_z80();
+}
+
+/**
+ * Update the Z80 area of the misc_*() page table after a BUSREQ change.
+ */
+void md::misc_memory_map_z80()
+{
+	struct bus_page *page = &bus_map[(M68K_IO_START >> 16)];
+
+	if (z80_st_busreq) {
+		page->readbyte = &md::m68k_Z80_read;
+		page->writebyte = &md::m68k_Z80_write;
+	}
+	else {
+		page->readbyte = &md::m68k_Z80_read_nobus;
+		page->writebyte = &md::m68k_Z80_write_nobus;
+	}
+#ifdef WITH_PICO
+	if (pico_enabled)
+		page->readbyte = &md::m68k_PICO_read;
+#endif
+}
+
 #ifdef WITH_MUSA
 
 // read/write functions called by the CPU to access memory.
@@ -560,8 +778,7 @@ extern "C" unsigned int m68k_read_memory_16(unsigned int address)
 
 extern "C" unsigned int m68k_read_memory_32(unsigned int address)
 {
-	return ((md::md_musa->misc_readword(address) << 16) |
-		(md::md_musa->misc_readword(address + 2) & 0xffff));
+	return md::md_musa->misc_readlong(address);
 }
 
 /* Read data immediately following the PC */
@@ -599,8 +816,7 @@ extern "C" void m68k_write_memory_16(unsigned int address, unsigned int value)
 
 extern "C" void m68k_write_memory_32(unsigned int address, unsigned int value)
 {
-	md::md_musa->misc_writeword(address, ((value >> 16) & 0xffff));
-	md::md_musa->misc_writeword((address + 2), (value & 0xffff));
+	md::md_musa->misc_writelong(address, value);
 }
 
 #endif // WITH_MUSA
@@ -620,8 +836,7 @@ extern "C" uint32_t cyclone_read_memory_16(uint32_t address)
 
 extern "C" uint32_t cyclone_read_memory_32(uint32_t address)
 {
-	return ((md::md_cyclone->misc_readword(address) << 16) |
-		(md::md_cyclone->misc_readword(address + 2) & 0xffff));
+	return md::md_cyclone->misc_readlong(address);
 }
 
 /* Write to anywhere */
@@ -637,8 +852,7 @@ extern "C" void cyclone_write_memory_16(uint32_t address, uint16_t value)
 
 extern "C" void cyclone_write_memory_32(uint32_t address, uint32_t value)
 {
-	md::md_cyclone->misc_writeword(address, ((value >> 16) & 0xffff));
-	md::md_cyclone->misc_writeword((address + 2), (value & 0xffff));
+	md::md_cyclone->misc_writelong(address, value);
 }
 
 uintptr_t md::checkpc(uintptr_t pc)
@@ -201,6 +201,10 @@ void m68k_write_memory_32_pd(unsigned int address, unsigned int value);
  * for faster direct access without having to use the above functions.
  * See m68k_mem_t definition.
  *
+ * Regions are looked up through a 64KB page table rebuilt by this function,
+ * pages not entirely covered by a region use the above functions instead.
+ * The array must not be modified without registering it again.
+ *
  * Enable this functionality with M68K_REGISTER_MEMORY in m68kconf.h.
  */
 void m68k_register_memory(m68k_mem_t memory[], unsigned int len);
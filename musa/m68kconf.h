@@ -80,6 +80,8 @@
 /* If ON, m68k_register_memory() can be used to register an array of memory
  * regions directly accessible from Musashi without having to call
  * intermediate read/write functions.
+ * Opcodes and immediate data are then also fetched directly from the region
+ * PC is in, m68k_read_immediate_xx() is only called outside of them.
  */
 #define M68K_REGISTER_MEMORY        OPT_ON
 
@@ -680,9 +680,57 @@ void m68k_set_instr_hook_callback(int  (*callback)(void))
 
 void m68k_register_memory(m68k_mem_t memory[], unsigned int len)
 {
+	unsigned int i;
+	unsigned int j;
+
 	m68ki_cpu.mem = (void *)memory;
 	m68ki_cpu.mem_len = len;
+	/* Invalidate the fetch window. */
+	m68ki_cpu.fetch_page = ~0u;
+	m68ki_cpu.fetch_mem = NULL;
+	/* Only pages entirely inside the first region they overlap are
+	 * mapped, the others go through m68k_(read|write)_*(). */
+	for (i = 0; (i != 0x100); ++i) {
+		uint start = (i << 16);
+		uint end = (start + 0x10000);
+
+		m68ki_cpu.mem_map[i] = NULL;
+		if (memory == NULL)
+			continue;
+		for (j = 0; (j != len); ++j) {
+			m68k_mem_t *mem = &memory[j];
+
+			if ((mem->size == 0) ||
+			    (end <= mem->addr) ||
+			    (start >= (mem->addr + mem->size)))
+				continue;
+			if ((start >= mem->addr) &&
+			    (end <= (mem->addr + mem->size)))
+				m68ki_cpu.mem_map[i] = mem;
+			break;
+		}
+	}
+}
+
+#if M68K_REGISTER_MEMORY
+/* Point the fetch window at the 64KB page containing address. It is only
+ * looked up again once PC leaves that page (jumps, branches, exceptions or
+ * running past its end). Reading through the host pointer means writes to
+ * RAM are always seen. */
+void m68ki_fetch_update(uint address)
+{
+	m68k_mem_t *mem = m68ki_locate_memory(address);
+
+	m68ki_cpu.fetch_page = (address >> 16);
+	if ((mem == NULL) || (!mem->x)) {
+		m68ki_cpu.fetch_mem = NULL;
+		return;
+	}
+	m68ki_cpu.fetch_mem = &((uint8 *)mem->mem)
+		[(((address & 0xffff0000) - mem->addr) & mem->mask)];
+	m68ki_cpu.fetch_swab = mem->swab;
 }
+#endif /* M68K_REGISTER_MEMORY */
 
 #include <stdio.h>
 /* Set the CPU type. */
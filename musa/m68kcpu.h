@@ -850,6 +850,13 @@ typedef struct
 	/* Memory regions if defined */
 	m68k_mem_t (*mem)[];
 	unsigned int mem_len;
+	/* Region for each 64KB page of the 24-bit address space, NULL when
+	 * none or several of them cover it (see m68k_register_memory()) */
+	m68k_mem_t *mem_map[0x100];
+	/* Instruction fetch window, the mem_map page PC was last seen in */
+	uint fetch_page;
+	uint8 *fetch_mem;
+	uint fetch_swab;
 
 	/* Callbacks to host */
 	int  (*int_ack_callback)(int int_line);           /* Interrupt Acknowledge */
@@ -883,6 +890,13 @@ extern uint           m68ki_aerr_fc;
 INLINE uint m68ki_read_imm_16(void);
 INLINE uint m68ki_read_imm_32(void);
 
+#if M68K_REGISTER_MEMORY
+/* Read program data through the fetch window */
+INLINE uint m68ki_read_fetch_16(uint address);
+INLINE uint m68ki_read_fetch_32(uint address);
+void m68ki_fetch_update(uint address);
+#endif /* M68K_REGISTER_MEMORY */
+
 /* Read data with specific function code */
 INLINE uint m68ki_read_8_fc  (uint address, uint fc);
 INLINE uint m68ki_read_16_fc (uint address, uint fc);
@@ -1019,13 +1033,13 @@ INLINE uint m68ki_read_imm_16(void)
 	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+		CPU_PREF_DATA = m68ki_read_fetch_32(ADDRESS_68K(CPU_PREF_ADDR));
 	}
 	REG_PC += 2;
 	return MASK_OUT_ABOVE_16(CPU_PREF_DATA >> ((2-((REG_PC-2)&2))<<3));
 #else
 	REG_PC += 2;
-	return m68k_read_immediate_16(ADDRESS_68K(REG_PC-2));
+	return m68ki_read_fetch_16(ADDRESS_68K(REG_PC-2));
 #endif /* M68K_EMULATE_PREFETCH */
 }
 INLINE uint m68ki_read_imm_32(void)
@@ -1038,14 +1052,14 @@ INLINE uint m68ki_read_imm_32(void)
 	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+		CPU_PREF_DATA = m68ki_read_fetch_32(ADDRESS_68K(CPU_PREF_ADDR));
 	}
 	temp_val = CPU_PREF_DATA;
 	REG_PC += 2;
 	if(MASK_OUT_BELOW_2(REG_PC) != CPU_PREF_ADDR)
 	{
 		CPU_PREF_ADDR = MASK_OUT_BELOW_2(REG_PC);
-		CPU_PREF_DATA = m68k_read_immediate_32(ADDRESS_68K(CPU_PREF_ADDR));
+		CPU_PREF_DATA = m68ki_read_fetch_32(ADDRESS_68K(CPU_PREF_ADDR));
 		temp_val = MASK_OUT_ABOVE_32((temp_val << 16) | (CPU_PREF_DATA >> 16));
 	}
 	REG_PC += 2;
@@ -1055,7 +1069,7 @@ INLINE uint m68ki_read_imm_32(void)
 	m68ki_set_fc(FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	m68ki_check_address_error(REG_PC, MODE_READ, FLAG_S | FUNCTION_CODE_USER_PROGRAM); /* auto-disable (see m68kcpu.h) */
 	REG_PC += 4;
-	return m68k_read_immediate_32(ADDRESS_68K(REG_PC-4));
+	return m68ki_read_fetch_32(ADDRESS_68K(REG_PC-4));
 #endif /* M68K_EMULATE_PREFETCH */
 }
 
@@ -1067,18 +1081,11 @@ INLINE uint m68ki_read_imm_32(void)
 
 INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 {
-	unsigned int i;
-
-	if (m68ki_cpu.mem == NULL)
+#if M68K_EMULATE_EC020 || M68K_EMULATE_020 || M68K_EMULATE_040
+	if (address > 0xffffff)
 		return NULL;
-	for (i = 0; (i != m68ki_cpu.mem_len); ++i) {
-		m68k_mem_t *mem = &(*m68ki_cpu.mem)[i];
-
-		if (((address ^ mem->swab) >= mem->addr) &&
-		    ((address ^ mem->swab) < (mem->addr + mem->size)))
-			return mem;
-	}
-	return NULL;
+#endif
+	return m68ki_cpu.mem_map[(address >> 16)];
 }
 
 #define m68ki_read_memory_8_direct(a)					\
@@ -1167,8 +1174,32 @@ INLINE m68k_mem_t *m68ki_locate_memory(uint address)
 	}								\
 	while (0);
 
+/* Program reads are served from the registered region PC is currently in,
+ * see m68ki_fetch_update(). */
+INLINE uint m68ki_read_fetch_16(uint address)
+{
+	if ((address >> 16) != m68ki_cpu.fetch_page)
+		m68ki_fetch_update(address);
+	if (m68ki_cpu.fetch_mem != NULL) {
+		uint8 *m = &m68ki_cpu.fetch_mem[(address & 0xffff)];
+
+		return ((m[m68ki_cpu.fetch_swab] << 8) |
+			m[(m68ki_cpu.fetch_swab ^ 1)]);
+	}
+	return m68k_read_immediate_16(address);
+}
+
+INLINE uint m68ki_read_fetch_32(uint address)
+{
+	return ((m68ki_read_fetch_16(address) << 16) |
+		m68ki_read_fetch_16(ADDRESS_68K(address + 2)));
+}
+
 #else /* M68K_REGISTER_MEMORY */
 
+#define m68ki_read_fetch_16(a) m68k_read_immediate_16(a)
+#define m68ki_read_fetch_32(a) m68k_read_immediate_32(a)
+
 #define m68ki_read_memory_8_direct(a) (void)0
 #define m68ki_read_memory_16_direct(a) (void)0
 #define m68ki_read_memory_32_direct(a) (void)0
@@ -131,7 +131,7 @@ void md::fm_reset()
 	}
 	SN76496_init(0,
 		     (((pal) ? PAL_MCLK : NTSC_MCLK) / 15),
-		     dgen_soundrate, 16);
+		     snd_rate, 16);
 }
 
 void md::dac_init()
@@ -47,6 +47,16 @@ unsigned int pd_sound_rp();
 unsigned int pd_sound_wp();
 // And this function is called to commit the sound buffers to be played.
 void pd_sound_write();
+// Sound buffer status, in samples. Writing never waits for the buffer to
+// be played, what doesn't fit is dropped (overrun) and silence is played
+// when it runs out (underrun).
+struct pd_sound_status {
+	unsigned int fill; // samples waiting to be played
+	unsigned int size; // maximum number of samples
+	unsigned long overruns;
+	unsigned long underruns;
+};
+void pd_sound_status(struct pd_sound_status *st);
 
 // Register platform-specific rc variables
 void pd_rc();
@@ -15,46 +15,6 @@
 #include "pd.h"
 #include "rc-vars.h"
 
-// This is marked each time the palette is updated. Handy for the 8bpp
-// implementation, so we don't waste time changing the palette unnecessarily.
-int pal_dirty;
-
-// Macros, to route draw_tile and draw_tile_solid to the right handler
-
-#define draw_tile(which, line, where) \
-	    draw_tile2((which),(line),(where));
-
-#define draw_tile_solid(which, line, where) \
-	    draw_tile2_solid((which),(line),(where));
-
-/*
-#define draw_tile(which, line, where) \
-	switch(Bpp)\
-	  {\
-	  case 1:\
-	    draw_tile1((which),(line),(where)); break;\
-	  case 2:\
-	    draw_tile2((which),(line),(where)); break;\
-	  case 3:\
-	    draw_tile3((which),(line),(where)); break;\
-	  case 4:\
-	    draw_tile4((which),(line),(where)); break;\
-	  }
-
-#define draw_tile_solid(which, line, where) \
-	switch(Bpp)\
-	  {\
-	  case 1:\
-	    draw_tile1_solid((which),(line),(where)); break;\
-	  case 2:\
-	    draw_tile2_solid((which),(line),(where)); break;\
-	  case 3:\
-	    draw_tile3_solid((which),(line),(where)); break;\
-	  case 4:\
-	    draw_tile4_solid((which),(line),(where)); break;\
-	  }
-*/
-
 // Silly utility function, get a big-endian word
 #ifdef WORDS_BIGENDIAN
 static inline int get_word(unsigned char *where)
@@ -64,562 +24,153 @@ static inline int get_word(unsigned char *where)
   { return (where[0] << 8) | where[1]; }
 #endif
 
-// Tile pixel masks
-#ifdef WORDS_BIGENDIAN
-#  define PIXEL0 (0xf0000000)
-#  define PIXEL1 (0x0f000000)
-#  define PIXEL2 (0x00f00000)
-#  define PIXEL3 (0x000f0000)
-#  define PIXEL4 (0x0000f000)
-#  define PIXEL5 (0x00000f00)
-#  define PIXEL6 (0x000000f0)
-#  define PIXEL7 (0x0000000f)
-#  define SHIFT0 (28)
-#  define SHIFT1 (24)
-#  define SHIFT2 (20)
-#  define SHIFT3 (16)
-#  define SHIFT4 (12)
-#  define SHIFT5 ( 8)
-#  define SHIFT6 ( 4)
-#  define SHIFT7 ( 0)
-#else // WORDS_BIGENDIAN
-#  define PIXEL0 (0x000000f0)
-#  define PIXEL1 (0x0000000f)
-#  define PIXEL2 (0x0000f000)
-#  define PIXEL3 (0x00000f00)
-#  define PIXEL4 (0x00f00000)
-#  define PIXEL5 (0x000f0000)
-#  define PIXEL6 (0xf0000000)
-#  define PIXEL7 (0x0f000000)
-#  define SHIFT0 ( 4)
-#  define SHIFT1 ( 0)
-#  define SHIFT2 (12)
-#  define SHIFT3 ( 8)
-#  define SHIFT4 (20)
-#  define SHIFT5 (16)
-#  define SHIFT6 (28)
-#  define SHIFT7 (24)
-#endif // WORDS_BIGENDIAN
-
-#ifdef WITH_X86_TILES
-extern "C" {
-
-void asm_tiles_init(unsigned char *vram,
-		    unsigned char *reg,
-		    unsigned *highpal);
-
-void drawtile1(int which, int line, unsigned char *where);
-void drawtile1_solid(int which, int line, unsigned char *where);
-void drawtile2(int which, int line, unsigned char *where);
-void drawtile2_solid(int which, int line, unsigned char *where);
-void drawtile3(int which, int line, unsigned char *where);
-void drawtile3_solid(int which, int line, unsigned char *where);
-void drawtile4(int which, int line, unsigned char *where);
-void drawtile4_solid(int which, int line, unsigned char *where);
-}
-
-// Pass off these calls to assembler counterparts
-inline void md_vdp::draw_tile1_solid(int which, int line, unsigned char *where)
-  { drawtile1_solid(which, line, where); }
-
-inline void md_vdp::draw_tile1(int which, int line, unsigned char *where)
-  { drawtile1(which, line, where); }
-
-inline void md_vdp::draw_tile2_solid(int which, int line, unsigned char *where)
-  { drawtile2_solid(which, line, where); }
-
-inline void md_vdp::draw_tile2(int which, int line, unsigned char *where)
-  { drawtile2(which, line, where); }
-
-inline void md_vdp::draw_tile3_solid(int which, int line, unsigned char *where)
-  { drawtile3_solid(which, line, where); }
-
-inline void md_vdp::draw_tile3(int which, int line, unsigned char *where)
-  { drawtile3(which, line, where); }
-
-inline void md_vdp::draw_tile4_solid(int which, int line, unsigned char *where)
-  { drawtile4_solid(which, line, where); }
-
-inline void md_vdp::draw_tile4(int which, int line, unsigned char *where)
-  { drawtile4(which, line, where); }
-
-#else // WITH_X86_TILES
-
 static bool has_zero_nibbles(uint32_t u32)
 {
 	return ((u32 - 0x11111111) & ~u32 & 0x88888888);
 }
 
-// Blit tile solidly, for 1 byte-per-pixel
-inline void md_vdp::draw_tile1_solid(int which, int line, unsigned char *where)
-{
-  unsigned tile, pal;
-
-  pal = (which >> 9 & 0x30); // Determine which 16-color palette
+// tile_cache_flags[]
+#define TILE_EMPTY 0x01 // all pixels are transparent
+#define TILE_SOLID 0x02 // no transparent pixels
 
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
+// line_buf[] pixels, a CRAM index plus the priority of the tile it came from.
+#define LINE_INDEX 0x3f
+#define LINE_PRIO 0x40
 
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    } else {
-      *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
-    }
-}
-
-// Blit tile, leaving color zero transparent, for 1 byte per pixel
-inline void md_vdp::draw_tile1(int which, int line, unsigned char *where)
+// Decode VRAM blocks marked in dirt[0x00-0x1f] into tile_cache[], one byte
+// per pixel for each 32-bit row of tile data. Nothing else uses those dirt
+// bits, they're cleared here.
+void md_vdp::tile_cache_update()
 {
-  unsigned tile, pal;
-
-  pal = (which >> 9 & 0x30); // Determine which 16-color palette
+  unsigned int i;
 
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-  // If the tile is all 0's, why waste the time?
-  if(!tile) return;
+  for (i = 0; (i != 0x20); ++i)
+    {
+      unsigned int bit;
 
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    }
-    else {
-      *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
-    }
-    return;
-  }
+      if (!dirt[i])
+	continue;
+      for (bit = 0; (bit != 8); ++bit)
+	{
+	  unsigned int row = (((i << 3) | bit) << 6);
+	  unsigned int end = (row + 64);
 
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      if(tile & PIXEL7) *(where  ) = ((tile & PIXEL7)>>SHIFT7) | pal;
-      if(tile & PIXEL6) *(where+1) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      if(tile & PIXEL5) *(where+2) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      if(tile & PIXEL4) *(where+3) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      if(tile & PIXEL3) *(where+4) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      if(tile & PIXEL2) *(where+5) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      if(tile & PIXEL1) *(where+6) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      if(tile & PIXEL0) *(where+7) = ((tile & PIXEL0)>>SHIFT0) | pal;
-    } else {
-      if(tile & PIXEL0) *(where  ) = ((tile & PIXEL0)>>SHIFT0) | pal;
-      if(tile & PIXEL1) *(where+1) = ((tile & PIXEL1)>>SHIFT1) | pal;
-      if(tile & PIXEL2) *(where+2) = ((tile & PIXEL2)>>SHIFT2) | pal;
-      if(tile & PIXEL3) *(where+3) = ((tile & PIXEL3)>>SHIFT3) | pal;
-      if(tile & PIXEL4) *(where+4) = ((tile & PIXEL4)>>SHIFT4) | pal;
-      if(tile & PIXEL5) *(where+5) = ((tile & PIXEL5)>>SHIFT5) | pal;
-      if(tile & PIXEL6) *(where+6) = ((tile & PIXEL6)>>SHIFT6) | pal;
-      if(tile & PIXEL7) *(where+7) = ((tile & PIXEL7)>>SHIFT7) | pal;
+	  if (!(dirt[i] & (1 << bit)))
+	    continue;
+	  for (; (row != end); ++row)
+	    {
+	      const uint8_t *src = &vram[(row << 2)];
+	      uint8_t *pix = tile_cache[row];
+	      uint32_t tile = ((src[0] << 24) | (src[1] << 16) |
+			       (src[2] << 8) | src[3]);
+
+	      pix[0] = (src[0] >> 4); pix[1] = (src[0] & 0x0f);
+	      pix[2] = (src[1] >> 4); pix[3] = (src[1] & 0x0f);
+	      pix[4] = (src[2] >> 4); pix[5] = (src[2] & 0x0f);
+	      pix[6] = (src[3] >> 4); pix[7] = (src[3] & 0x0f);
+	      if (tile == 0)
+		tile_cache_flags[row] = TILE_EMPTY;
+	      else if (!has_zero_nibbles(tile))
+		tile_cache_flags[row] = TILE_SOLID;
+	      else
+		tile_cache_flags[row] = 0;
+	    }
+	}
+      dirt[i] = 0;
     }
 }
 
-// Blit tile solidly, for 2 byte-per-pixel
-inline void md_vdp::draw_tile2_solid(int which, int line, unsigned char *where)
+// tile_cache[] row of a given line of a tile.
+inline unsigned int md_vdp::tile_row(int which, int line)
 {
-  unsigned tile, temp;
-  uint32_t *pal;
-  unsigned short *wwhere = (unsigned short*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
   if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-  // Restore the original color
-  *pal = temp;
+    return ((((which & 0x7ff) << 4) + (line << 1)) & 0x3fff);
+  return (((which & 0x7ff) << 3) + line);
 }
 
-// Blit tile, leaving color zero transparent, for 2 byte per pixel
-inline void md_vdp::draw_tile2(int which, int line, unsigned char *where)
+// Blit tile solidly into the line buffer, transparent pixels get the
+// background color. Only used for plane B, which is drawn first.
+inline void md_vdp::draw_tile1_solid(int which, int line, unsigned char *where)
 {
-  unsigned tile;
-  uint32_t *pal;
-  unsigned short *wwhere = (unsigned short*)where;
+  unsigned row, pal, bg, i;
+  const uint8_t *pix;
+  int step;
 
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
+  // Determine which 16-color palette, keep the priority bit
+  pal = (which >> 9 & (0x30 | LINE_PRIO));
+  bg = (reg[7] & 0x3f); // Get background color
 
   if(which & 0x1000) // y flipped
     line ^= 7; // take from the bottom, instead of the top
 
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-  // If the tile is all 0's, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    }
-    else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
+  row = tile_row(which, line);
+  if (tile_cache_flags[row] & TILE_EMPTY) {
+    memset(where, bg, 8);
     return;
   }
-
-  // Blit the tile!
+  pix = tile_cache[row];
+  step = 1;
   if(which & 0x800) // x flipped
     {
-      if(tile & PIXEL7) *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      if(tile & PIXEL6) *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL5) *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL4) *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL3) *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL2) *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL1) *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL0) *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      if(tile & PIXEL0) *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      if(tile & PIXEL1) *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL2) *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL3) *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL4) *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL5) *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL6) *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL7) *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
+      pix += 7;
+      step = -1;
     }
-}
-
-inline void md_vdp::draw_tile3_solid(int which, int line, unsigned char *where)
-{
-  unsigned tile, temp;
-  uint32_t *pal;
-  uint24_t *wwhere = (uint24_t *)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
 
   // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    } else {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-    }
-  // Restore the original color
-  *pal = temp;
-}
-
-inline void md_vdp::draw_tile3(int which, int line, unsigned char *where)
-{
-  unsigned tile;
-  uint32_t *pal;
-  uint24_t *wwhere = (uint24_t *)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
+  if (tile_cache_flags[row] & TILE_SOLID)
+    for (i = 0; (i != 8); ++i, pix += step)
+      where[i] = (*pix | pal);
   else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-  // If it's empty, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    }
-    else {
-      u24cpy(&wwhere[0], (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      u24cpy(&wwhere[1], (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      u24cpy(&wwhere[2], (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      u24cpy(&wwhere[3], (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      u24cpy(&wwhere[4], (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      u24cpy(&wwhere[5], (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      u24cpy(&wwhere[6], (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      u24cpy(&wwhere[7], (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-    }
-    return;
-  }
-
-  // Blit the tile!
-  if(which & 0x800) // x flipped
-    {
-      if (tile & PIXEL7)
-		u24cpy(&wwhere[0],
-		       (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-      if(tile & PIXEL6)
-		u24cpy(&wwhere[1],
-		       (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      if(tile & PIXEL5)
-		u24cpy(&wwhere[2],
-		       (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      if(tile & PIXEL4)
-		u24cpy(&wwhere[3],
-		       (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      if(tile & PIXEL3)
-		u24cpy(&wwhere[4],
-		       (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      if(tile & PIXEL2)
-		u24cpy(&wwhere[5],
-		       (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      if(tile & PIXEL1)
-		u24cpy(&wwhere[6],
-		       (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      if(tile & PIXEL0)
-		u24cpy(&wwhere[7],
-		       (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-    } else {
-      if(tile & PIXEL0)
-		u24cpy(&wwhere[0],
-		       (uint24_t *)&pal[((tile & PIXEL0) >> SHIFT0)]);
-      if(tile & PIXEL1)
-		u24cpy(&wwhere[1],
-		       (uint24_t *)&pal[((tile & PIXEL1) >> SHIFT1)]);
-      if(tile & PIXEL2)
-		u24cpy(&wwhere[2],
-		       (uint24_t *)&pal[((tile & PIXEL2) >> SHIFT2)]);
-      if(tile & PIXEL3)
-		u24cpy(&wwhere[3],
-		       (uint24_t *)&pal[((tile & PIXEL3) >> SHIFT3)]);
-      if(tile & PIXEL4)
-		u24cpy(&wwhere[4],
-		       (uint24_t *)&pal[((tile & PIXEL4) >> SHIFT4)]);
-      if(tile & PIXEL5)
-		u24cpy(&wwhere[5],
-		       (uint24_t *)&pal[((tile & PIXEL5) >> SHIFT5)]);
-      if(tile & PIXEL6)
-		u24cpy(&wwhere[6],
-		       (uint24_t *)&pal[((tile & PIXEL6) >> SHIFT6)]);
-      if(tile & PIXEL7)
-		u24cpy(&wwhere[7],
-		       (uint24_t *)&pal[((tile & PIXEL7) >> SHIFT7)]);
-    }
+    for (i = 0; (i != 8); ++i, pix += step)
+      where[i] = (*pix ? (*pix | pal) : bg);
 }
 
-// Blit tile solidly, for 4 byte-per-pixel
-inline void md_vdp::draw_tile4_solid(int which, int line, unsigned char *where)
+// Blit tile into the line buffer, leaving color zero transparent. Low
+// priority tiles don't cover pixels that came from high priority ones, so
+// everything but sprites is done in a single pass.
+inline void md_vdp::draw_tile1(int which, int line, unsigned char *where)
 {
-  unsigned tile, temp;
-  uint32_t *pal;
-  unsigned *wwhere = (unsigned*)where;
+  unsigned row, pal, i;
+  const uint8_t *pix;
+  int step;
 
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-  temp = *pal; *pal = highpal[reg[7]&0x3f]; // Get background color
+  // Determine which 16-color palette, keep the priority bit
+  pal = (which >> 9 & (0x30 | LINE_PRIO));
 
   if(which & 0x1000) // y flipped
     line ^= 7; // take from the bottom, instead of the top
 
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-
-  // Blit the tile!
+  row = tile_row(which, line);
+  // If the tile is all 0's, why waste the time?
+  if (tile_cache_flags[row] & TILE_EMPTY) return;
+  pix = tile_cache[row];
+  step = 1;
   if(which & 0x800) // x flipped
     {
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-  // Restore the original color
-  *pal = temp;
-}
-
-// Blit tile, leaving color zero transparent, for 4 byte per pixel
-inline void md_vdp::draw_tile4(int which, int line, unsigned char *where)
-{
-  unsigned tile;
-  uint32_t *pal;
-  unsigned *wwhere = (unsigned*)where;
-
-  pal = highpal + (which >> 9 & 0x30); // Determine which 16-color palette
-
-  if(which & 0x1000) // y flipped
-    line ^= 7; // take from the bottom, instead of the top
-
-  if(reg[12] & 2) // interlace
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 6) + (line << 3));
-  else
-    tile = *(unsigned*)(vram + ((which&0x7ff) << 5) + (line << 2));
-  // If the tile is all 0's, why waste the time?
-  if(!tile) return;
-
-  // If the tile doesn't have any transparent pixels, draw it solidly.
-  if (!has_zero_nibbles(tile)) {
-    if (which & 0x800) {
-      // x flipped
-      *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
+      pix += 7;
+      step = -1;
     }
-    else {
-      *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
-    }
-    return;
-  }
 
-  // Blit the tile!
-  if(which & 0x800) // x flipped
+  // Low priority, only draw over low priority pixels.
+  if (!(pal & LINE_PRIO))
     {
-      if(tile & PIXEL7) *(wwhere  ) = pal[((tile & PIXEL7)>>SHIFT7)];
-      if(tile & PIXEL6) *(wwhere+1) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL5) *(wwhere+2) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL4) *(wwhere+3) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL3) *(wwhere+4) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL2) *(wwhere+5) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL1) *(wwhere+6) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL0) *(wwhere+7) = pal[((tile & PIXEL0)>>SHIFT0)];
-    } else {
-      if(tile & PIXEL0) *(wwhere  ) = pal[((tile & PIXEL0)>>SHIFT0)];
-      if(tile & PIXEL1) *(wwhere+1) = pal[((tile & PIXEL1)>>SHIFT1)];
-      if(tile & PIXEL2) *(wwhere+2) = pal[((tile & PIXEL2)>>SHIFT2)];
-      if(tile & PIXEL3) *(wwhere+3) = pal[((tile & PIXEL3)>>SHIFT3)];
-      if(tile & PIXEL4) *(wwhere+4) = pal[((tile & PIXEL4)>>SHIFT4)];
-      if(tile & PIXEL5) *(wwhere+5) = pal[((tile & PIXEL5)>>SHIFT5)];
-      if(tile & PIXEL6) *(wwhere+6) = pal[((tile & PIXEL6)>>SHIFT6)];
-      if(tile & PIXEL7) *(wwhere+7) = pal[((tile & PIXEL7)>>SHIFT7)];
+      for (i = 0; (i != 8); ++i, pix += step)
+	if ((*pix) && (!(where[i] & LINE_PRIO)))
+	  where[i] = (*pix | pal);
+      return;
     }
+  // If the tile doesn't have any transparent pixels, draw it solidly.
+  if (tile_cache_flags[row] & TILE_SOLID)
+    for (i = 0; (i != 8); ++i, pix += step)
+      where[i] = (*pix | pal);
+  else
+    for (i = 0; (i != 8); ++i, pix += step)
+      if (*pix)
+	where[i] = (*pix | pal);
 }
-#endif // WITH_X86_TILES
 
-// Draw the window (front or back)
-void md_vdp::draw_window(int line, int front)
+// Draw the window
+void md_vdp::draw_window(int line)
 {
   int size;
   int x, y, w, start;
@@ -646,7 +197,7 @@ void md_vdp::draw_window(int line, int front)
       start = 24;
     }
   add = -2;
-  where = dest + (start * (int)Bpp);
+  where = dest + start;
 	for (x = -1; (x < w); ++x) {
 		if (!total_window) {
 			if (reg[17] & 0x80) {
@@ -660,11 +211,10 @@ void md_vdp::draw_window(int line, int front)
 		}
 		which = get_word(((unsigned char *)vram) +
 				 (pl + (add & ((size - 1) << 1))));
-		if ((which >> 15) == front)
-			draw_tile(which, (line & 7), where);
+		draw_tile1(which, (line & 7), where);
 	skip:
 		add += 2;
-		where += Bpp_times8;
+		where += 8;
 	}
 }
 
@@ -716,10 +266,11 @@ inline void md_vdp::sprite_masking_overflow(int line)
 {
 	int masking_sprite_index;
 	bool masking_effective;
-	int frame_limit;
+	int frame_end;
 	int line_limit;
 	int dots;
-	int i;
+	int low = 0;
+	unsigned int n;
 
 	/*
 	 * Search for the highest priority sprite with x = 0. Call this sprite
@@ -741,48 +292,34 @@ inline void md_vdp::sprite_masking_overflow(int line)
 	masking_effective = (sprite_overflow_line == (line - 1));
 	// Set sprites and dots limits for the current line.
 	if (reg[12] & 1) {
-		frame_limit = 80;
 		line_limit = 20;
 		dots = 320;
 	}
 	else {
-		frame_limit = 64;
 		line_limit = 16;
 		dots = 256;
 	}
-	for (i = 0; i < sprite_count; i++) {
-		int x, y, w, h;
-		int idx;
-		uint8_t *sprite;
+	frame_end = sprite_frame_end[(reg[12] & 1)];
+	// Only sprites found on the current line, in sprite_order[] order.
+	for (n = sprite_lines_start[line];
+	     (n != sprite_lines_start[(line + 1)]);
+	     ++n) {
+		int i = sprite_lines[n];
+		const struct sprite_info& info = sprite_infos[i];
 
 		// First, make sure the frame limit hasn't been reached.
-		idx = sprite_order[i];
-		if (idx >= frame_limit) {
-			if (masking_sprite_index == -1)
-				masking_sprite_index = (i - 1);
+		if (i >= frame_end)
 			break;
-		}
-		// Get current sprite coordinates and dimensions.
-		sprite = (sprite_base + (idx << 3));
-		x = get_word(sprite + 6) & 0x1ff;
-		y = get_word(sprite);
-		if (reg[12] & 2)
-			y = ((y & 0x3fe) >> 1);
-		else
-			y &= 0x1ff;
-		h = (((sprite[2] & 0x03) << 3) + 8);
-		w = (((sprite[2] << 1) & 0x18) + 8);
-		// If this sprite isn't found on the current line, skip it.
-		if (!(((line + 0x80) >= y) && ((line + 0x80) < (y + h))))
-			continue;
+		if (!info.prio)
+			++low;
 		// Substract sprite from the dots limit and decrease the
 		// sprites limit.
-		dots -= w;
+		dots -= info.w;
 		--line_limit;
 		// If this sprite is not a masking sprite (x != 0), sprite
 		// masking becomes effective. The next sprite with (x == 0)
 		// will be a masking sprite.
-		if (x != 0)
+		if (!info.masking)
 			masking_effective = true;
 		// If a dot overflow occured, update sprite_overflow_line with
 		// the current line. This update must be done only once for a
@@ -797,7 +334,7 @@ inline void md_vdp::sprite_masking_overflow(int line)
 			else
 				dots = 0;
 			// Don't process any more sprites, exit from the loop.
-			break;
+			goto done;
 		}
 		// Check whether sprites limit has been reached.
 		if (line_limit == 0) {
@@ -806,9 +343,9 @@ inline void md_vdp::sprite_masking_overflow(int line)
 			if (masking_sprite_index == -1)
 				masking_sprite_index = i;
 			// Trigger sprite overflow bit (d6).
-			belongs.coo5 |= 0x40;
+			*status |= 0x40;
 			// Don't process any more sprites, exit from the loop.
-			break;
+			goto done;
 		}
 		// If sprite masking is effective and the current sprite is a
 		// masking sprite (x == 0), if we haven't already found one
@@ -816,147 +353,192 @@ inline void md_vdp::sprite_masking_overflow(int line)
 		// list as we still need to know whether a dot overflow
 		// occured.
 		if ((masking_effective) &&
-		    (x == 0) &&
+		    (info.masking) &&
 		    (masking_sprite_index == -1))
 			masking_sprite_index = i;
 	}
+	// Sprites past the frame limit are never displayed.
+	if ((frame_end < sprite_count) && (masking_sprite_index == -1))
+		masking_sprite_index = (frame_end - 1);
+done:
 	// If no masking sprite index was found, display them all.
 	if (masking_sprite_index == -1)
 		masking_sprite_index = (sprite_count - 1);
 	masking_sprite_index_cache = masking_sprite_index;
 	dots_cache = dots;
+	// Look for a sprite collision if there can be one and the bit isn't
+	// already set for this frame, otherwise spans are only built by
+	// draw_sprites() for lines that need them. Since this is done here
+	// only, drawn and skipped lines set the same bits.
+	sprite_spans_line = -1;
+	if ((low > 1) && (!(*status & 0x20))) {
+		sprite_spans_update(line, masking_sprite_index, dots);
+		// Trigger sprite collision bit (d5).
+		if (sprite_spans_collide())
+			*status |= 0x20;
+	}
 }
 
-inline void md_vdp::sprite_mask_add(uint8_t* dest, int pitch,
-				    struct sprite_info& info, int value)
+// Collect opaque runs of low priority sprites on a given line into
+// sprite_spans[], in the same order draw_sprites() goes through them.
+// Like draw_sprites(), stop at sprite "last" (see sprite_masking_overflow())
+// and truncate it if "dots" is negative.
+void md_vdp::sprite_spans_update(int line, int last, int dots)
 {
-	uint32_t *tile = info.tile;
-	int len = (info.tw * info.h);
-	int lines = (8 << info.inter);
-	int line = 0;
-	int wrap = 0;
-	int unit = 1;
-
-	dest += info.x;
-	dest += (pitch * info.y);
-	if (info.yflip) {
-		dest += (pitch * (info.h - 1));
-		pitch = -pitch;
-	}
-	if (info.xflip) {
-		dest += (info.w - 1);
-		unit = -unit;
-	}
-	while (len) {
-		uint_fast32_t dots = be2h32(*tile);
-		unsigned int tmp;
-
-		for (tmp = 0; (tmp != 8); ++tmp) {
-			assert(dest >= (uint8_t *)sprite_mask);
-			assert(dest < ((uint8_t *)sprite_mask +
-				       sizeof(sprite_mask)));
-			/*
-			 * If a non-transparent sprite dot has already been
-			 * drawn here, trigger the collision bit (d5).
-			 * FIXME: doing this here is hackish and doesn't take
-			 * sprites with the high priority bit into account.
-			 */
-			if (*dest != 0xff)
-				belongs.coo5 |= 0x20;
-#ifdef WORDS_BIGENDIAN
-			if (dots & 0x0000000f)
-				*dest = value;
-			dots >>= 4;
-#else
-			if (dots & 0xf0000000)
-				*dest = value;
-			dots <<= 4;
-#endif
-			dest += unit;
-		}
-		++tile;
-		++line;
-		if (line == lines) {
-			/* Next tile. */
-			line = 0;
-			++wrap;
-			if (wrap == info.th) {
-				/* Next tiles column. */
-				dest -= (pitch * (info.h - 1));
-				wrap = 0;
-			}
-			else {
-				/* Next tiles row. */
-				dest += (pitch - (8 * unit));
+	unsigned int n;
+
+	sprite_spans_count = 0;
+	sprite_spans_line = line;
+	for (n = sprite_lines_start[(line + 1)];
+	     (n != sprite_lines_start[line]);
+	     --n) {
+		int i = sprite_lines[(n - 1)];
+		const struct sprite_info& info = sprite_infos[i];
+		unsigned int which;
+		uint8_t dot[32];
+		int yoff;
+		int col;
+		int x;
+		int w;
+
+		// We only care about sprites with the low priority bit unset
+		// that are processed.
+		if ((i > last) || (info.prio))
+			continue;
+		yoff = (line - info.y);
+		w = info.w;
+		if ((i == last) && (dots < 0))
+			w += dots;
+		// Don't bother with hidden sprites.
+		if ((info.x >= 320) || ((info.x + w) < 0))
+			continue;
+		if (info.yflip)
+			yoff = (info.h - 1 - yoff);
+		// Opaque dots, left to right. Tiles are stored column by column.
+		which = get_word(info.sprite + 4);
+		for (col = 0; (col != (w >> 3)); ++col) {
+			unsigned int tile = (which + (col * info.th) + (yoff >> 3));
+			const uint8_t *row =
+				&vram[(tile_row(tile, (yoff & 7)) << 2)];
+			uint8_t *out = &dot[(col << 3)];
+			unsigned int b;
+
+			if (info.xflip)
+				out = &dot[(w - 8 - (col << 3))];
+			for (b = 0; (b != 4); ++b) {
+				uint8_t hi = (row[b] & 0xf0);
+				uint8_t lo = (row[b] & 0x0f);
+
+				if (info.xflip) {
+					out[(7 - (b << 1))] = hi;
+					out[(6 - (b << 1))] = lo;
+				}
+				else {
+					out[(b << 1)] = hi;
+					out[((b << 1) + 1)] = lo;
+				}
 			}
 		}
-		else {
-			/* Next line of dots. */
-			dest -= (8 * unit);
-			dest += pitch;
+		// Turn them into runs, clipped to what draw_sprites() can reach.
+		x = 0;
+		while (x != w) {
+			struct sprite_span *span;
+
+			if (!dot[x]) {
+				++x;
+				continue;
+			}
+			span = &sprite_spans[(sprite_spans_count++)];
+			span->x = (info.x + x);
+			while ((x != w) && (dot[x]))
+				++x;
+			span->end = (info.x + x);
+			span->index = i;
+			if (span->x < -8)
+				span->x = -8;
+			if (span->end > 328)
+				span->end = 328;
+			if (span->x >= span->end)
+				--sprite_spans_count;
 		}
-		--len;
 	}
 }
 
-inline void md_vdp::sprite_mask_generate()
+// Return true if runs of two different sprites overlap in sprite_spans[].
+inline bool md_vdp::sprite_spans_collide()
+{
+	unsigned int first = 0;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; (i != sprite_spans_count); ++i) {
+		const struct sprite_span *span = &sprite_spans[i];
+
+		// Runs of a given sprite are contiguous.
+		if (span->index != sprite_spans[first].index)
+			first = i;
+		for (j = 0; (j != first); ++j)
+			if ((sprite_spans[j].x < span->end) &&
+			    (sprite_spans[j].end > span->x))
+				return true;
+	}
+	return false;
+}
+
+// Return a bitmask of the 8 dots starting at x that are covered by a low
+// priority sprite with a lower sprite_order[] index than the given one.
+inline unsigned int md_vdp::sprite_spans_covered(int x, int index)
 {
-	int i;
+	unsigned int covered = 0;
+	unsigned int i;
 
-	memset(sprite_mask, 0xff, sizeof(sprite_mask));
-	for (i = (sprite_count - 1); (i >= 0); --i) {
-		sprite_info info;
+	// Spans are stored by decreasing index, only the last ones matter.
+	for (i = sprite_spans_count; (i != 0); --i) {
+		const struct sprite_span *span = &sprite_spans[(i - 1)];
+		int start = (span->x - x);
+		int end = (span->end - x);
 
-		get_sprite_info(info, sprite_order[i]);
-		// We only care about sprites with the low priority bit unset.
-		if (info.prio)
-			continue;
-		// Don't bother with hidden sprites.
-		if ((info.x >= 320) || ((info.x + info.w) < 0))
-			continue;
-		if ((info.y >= 256) || ((info.y + info.h) < 0))
+		if (span->index >= index)
+			break;
+		if ((start >= 8) || (end <= 0))
 			continue;
-		info.x += 0x80;
-		info.y += 0x80;
-		// Draw overlap mask for this sprite in a 512x512 virtual area.
-		sprite_mask_add((uint8_t *)sprite_mask, sizeof(sprite_mask[0]),
-				info, i);
+		if (start < 0)
+			start = 0;
+		if (end > 8)
+			end = 8;
+		covered |= ((0xff << start) & ~(0xff << end));
 	}
+	return covered;
 }
 
-inline void md_vdp::draw_sprites(int line, bool front)
+template <bool front>
+void md_vdp::draw_sprites(int line)
 {
   unsigned int which;
   int tx, ty, x, y, xend, ysize, yoff, i, masking_sprite_index;
   int dots;
   unsigned char *where;
-#ifdef WITH_DEBUG_VDP
-  static int ant[2];
-  static unsigned long ant_last[2];
-  unsigned long ant_cur;
+  unsigned int n;
 
-  if ((dgen_vdp_sprites_boxing) && (line == 0)) {
-    ant_cur = pd_usecs();
-    if ((ant_cur - ant_last[front]) > 100000) {
-      ant_last[front] = ant_cur;
-      ant[front] ^= 1;
-    }
-  }
-#endif
   masking_sprite_index = masking_sprite_index_cache;
-  dots = dots_cache;
-  // If dots_cache is less than zero, draw the first sprite partially.
-  if (dots > 0)
-    dots = 0;
   // Sprites have to be in reverse order :P
-  for (i = masking_sprite_index; i >= 0; --i)
+  for (n = sprite_lines_start[(line + 1)];
+       (n != sprite_lines_start[line]);
+       --n)
     {
-      sprite_info info;
+      i = sprite_lines[(n - 1)];
+      if (i > masking_sprite_index)
+	continue;
+      const struct sprite_info& info = sprite_infos[i];
 
-      get_sprite_info(info, sprite_order[i]);
       // Only do it if it's on the right priority.
       if (info.prio == front)
 	{
+	  // If dots_cache is less than zero, draw the first sprite
+	  // partially.
+	  dots = 0;
+	  if ((i == masking_sprite_index) && (dots_cache < 0))
+	    dots = dots_cache;
 	  which = get_word(info.sprite + 4);
 	  // Get the sprite's location
 	  y = info.y;
@@ -981,23 +563,23 @@ inline void md_vdp::draw_sprites(int line, bool front)
 	      if (!front) {
 		// x flipped?
 		if (which & 0x800) {
-		  where = dest + (xend * (int)Bpp);
+		  where = dest + xend;
 		  for(tx = xend; tx >= x; tx -= 8)
 		    {
 		      if(tx > -8 && tx < 320)
-			draw_tile(which, ty, where);
+			draw_tile1(which, ty, where);
 		      which += ysize;
-		      where -= Bpp_times8;
+		      where -= 8;
 		    }
 	        }
 		else {
-		  where = dest + (x * (int)Bpp);
+		  where = dest + x;
 		  for(tx = x; tx <= xend; tx += 8)
 		    {
 		      if(tx > -8 && tx < 320)
-			draw_tile(which, ty, where);
+			draw_tile1(which, ty, where);
 		      which += ysize;
-		      where += Bpp_times8;
+		      where += 8;
 		    }
 		}
 	      }
@@ -1006,118 +588,365 @@ inline void md_vdp::draw_sprites(int line, bool front)
 	      // list) but with this bit unset. Those have already been drawn
 	      // during the previous pass.
 	      else {
-		union {
-		  uint32_t t4[8];
-		  uint24_t t3[8];
-		  uint16_t t2[8];
-		  uint8_t t1[8];
-		} tile;
+		uint8_t tile[8];
+		unsigned int covered;
+
+		if (sprite_spans_line != line)
+		  sprite_spans_update(line, masking_sprite_index, dots_cache);
 
 		// x flipped?
 		if (which & 0x800) {
-		  where = dest + (xend * (int)Bpp);
+		  where = dest + xend;
 		  for (tx = xend; (tx >= x); tx -= 8) {
 		    if ((tx > -8) && (tx < 320)) {
 		      int xx;
 		      int xo;
 
-		      memcpy(tile.t1, where, Bpp_times8);
-		      draw_tile(which, ty, tile.t1);
+		      memcpy(tile, where, 8);
+		      draw_tile1(which, ty, tile);
+		      covered = sprite_spans_covered(tx, i);
 		      for (xx = tx, xo = 0; (xo != 8); ++xo, ++xx)
-			if (sprite_mask[(line + 0x80)][(xx + 0x80)] >= i)
-			  memcpy(&dest[(xx * (int)Bpp)],
-				 &tile.t1[(xo * (int)Bpp)],
-				 (int)Bpp);
+			if (!(covered & (1 << xo)))
+			  dest[xx] = tile[xo];
 		    }
 		    which += ysize;
-		    where -= Bpp_times8;
+		    where -= 8;
 		  }
 	        }
 		else {
-		  where = dest + (x * (int)Bpp);
+		  where = dest + x;
 		  for (tx = x; (tx <= xend); tx += 8) {
 		    if ((tx > -8) && (tx < 320)) {
 		      int xx;
 		      int xo;
 
-		      memcpy(tile.t1, where, Bpp_times8);
-		      draw_tile(which, ty, tile.t1);
+		      memcpy(tile, where, 8);
+		      draw_tile1(which, ty, tile);
+		      covered = sprite_spans_covered(tx, i);
 		      for (xx = tx, xo = 0; (xo != 8); ++xo, ++xx)
-			if (sprite_mask[(line + 0x80)][(xx + 0x80)] >= i)
-			  memcpy(&dest[(xx * (int)Bpp)],
-				 &tile.t1[(xo * (int)Bpp)],
-				 (int)Bpp);
+			if (!(covered & (1 << xo)))
+			  dest[xx] = tile[xo];
 		    }
 		    which += ysize;
-		    where += Bpp_times8;
+		    where += 8;
 		  }
 		}
 	      }
-#ifdef WITH_DEBUG_VDP
-	      if (dgen_vdp_sprites_boxing) {
-		uint32_t color[2] = {
-		  (uint32_t)dgen_vdp_sprites_boxing_bg,
-		  (uint32_t)dgen_vdp_sprites_boxing_fg
-		};
-		int ph;
-		int fx;
-
-		if ((ph = 0, (y == line)) ||
-		    (ph = 1, ((y + info.h - 1) == line)))
-		  for (fx = (ant[front] ^ ph); (fx < info.w); fx += 2)
-		    draw_pixel(this->bmap, (info.x + fx),
-			       line, color[info.prio]);
-		else
-		  draw_pixel(this->bmap,
-			     (((line & 1) == ant[front]) ?
-			      (info.x + info.w - 1) : info.x),
-			     line, color[info.prio]);
-	      }
-#endif
 	    }
 	}
-      dots = 0;
     }
 }
 
-// The body for the next few functions is in an extraneous header file.
-// Phil, I hope I left enough in this file for GLOBAL to hack it right. ;)
-// Thanks to John Stiles for this trick :)
-
-inline void md_vdp::draw_plane_back0(int line)
+#ifdef WITH_DEBUG_VDP
+// Sprite boxes go straight into the bmap, after the line buffer has been
+// converted. Same sprites as draw_sprites().
+void md_vdp::draw_sprites_boxing(int line, bool front)
 {
-#define FRONT 0
-#define PLANE 0
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+  static int ant[2];
+  static unsigned long ant_last[2];
+  unsigned long ant_cur;
+  uint32_t color[2] = {
+    (uint32_t)dgen_vdp_sprites_boxing_bg,
+    (uint32_t)dgen_vdp_sprites_boxing_fg
+  };
+  int i, y, xend, dots;
+  unsigned int n;
+
+  if (line == 0) {
+    ant_cur = pd_usecs();
+    if ((ant_cur - ant_last[front]) > 100000) {
+      ant_last[front] = ant_cur;
+      ant[front] ^= 1;
+    }
+  }
+  for (n = sprite_lines_start[(line + 1)];
+       (n != sprite_lines_start[line]);
+       --n)
+    {
+      int ph;
+      int fx;
+
+      i = sprite_lines[(n - 1)];
+      if (i > masking_sprite_index_cache)
+	continue;
+      const struct sprite_info& info = sprite_infos[i];
+
+      dots = 0;
+      if ((i == masking_sprite_index_cache) && (dots_cache < 0))
+	dots = dots_cache;
+      y = info.y;
+      xend = ((info.w - 8) + info.x + dots);
+      if ((info.prio != front) || (xend <= -8) || (info.x >= 320))
+	continue;
+      if ((ph = 0, (y == line)) ||
+	  (ph = 1, ((y + info.h - 1) == line)))
+	for (fx = (ant[front] ^ ph); (fx < info.w); fx += 2)
+	  draw_pixel(this->bmap, (info.x + fx),
+		     line, color[info.prio]);
+      else
+	draw_pixel(this->bmap,
+		   (((line & 1) == ant[front]) ?
+		    (info.x + info.w - 1) : info.x),
+		   line, color[info.prio]);
+    }
 }
+#endif
 
-inline void md_vdp::draw_plane_back1(int line)
+/*
+ * Looks up a vertical scroll value and sets some related variables.
+ */
+#define LOOKUP_YSCROLL_REC(rec_no)					\
+	do {								\
+		yscroll_amount = get_word(vsram + rec_no * 2) & 0x7ff;	\
+									\
+		/* interlace ? */					\
+		if (reg[12] & 2)					\
+			yscroll_amount >>= 1;				\
+									\
+		/* Offset for the line */				\
+		yscroll_amount += line;					\
+									\
+		yoff = ((yscroll_amount >> 3) & (ysize - 1));		\
+		tile_line = (tiles + ((xsize * yoff) & 0x1fff));	\
+		scan = (yscroll_amount & 7);				\
+	}								\
+	while (0)
+
+// Draw plane A (0) or B (1)
+template <int plane>
+void md_vdp::draw_plane(int line)
 {
-#define FRONT 0
-#define PLANE 1
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+	int xsize, ysize;
+	int x, scan = 0, w, xstart;
+	static int sizes[4] = { 32, 64, 64, 128 };
+	unsigned which;
+	unsigned char *where, *hscroll_rec_ptr, *tiles, *tile_line = NULL;
+	int xoff, yoff, xoff_mask;
+	int hscroll_amount, yscroll_amount = 0;
+	uint8_t two_cell_vscroll = 0;
+
+	/*
+	 * when VSCR bit is set in register 11, this is 'per 2-cell'
+	 * vertical scrolling as opposed to full screen vscrolling.
+	 */
+	two_cell_vscroll = ((reg[11] >> 2) & 0x1);
+
+	// Plane 0 is only where the window isn't
+	// This should make Herzog Zwei split screen work perfectly, and clean
+	// up those little glitches on Sonic 3's level select.
+	if (plane == 0) {
+		if (reg[18] & 0x80) {
+			// Window goes down, plane 0 goes up! :)
+			if ((line >> 3) >= (reg[18] & 0x1f))
+				return;
+		}
+		else {
+			// Window goes up, plane 0 goes down
+			if ((line >> 3) < (reg[18] & 0x1f))
+				return;
+		}
+	}
+
+	/*
+	 * Get the vertical/horizontal scroll plane sizes
+	 *
+	 * 0b00: 32 cell
+	 * 0b01: 64 cell
+	 * 0b10: prohibited, but unlicensed games use this
+	 *       turns out to be 64.
+	 * 0b11: 128 cell
+	 */
+	xsize = (sizes[(reg[16] & 3)] << 1);
+	ysize = sizes[((reg[16] >> 4) & 3)];
+
+	/*
+	 * Here we compute pointer to the beginning of the  hscroll table.
+	 * The base address of the table is stored in reg[13] << 10.
+	 */
+	if (plane == 0) {
+		hscroll_rec_ptr = (vram + ((reg[13] << 10) & 0xfc00));
+		tiles = (vram + (reg[2] << 10));
+	}
+	else {
+		hscroll_rec_ptr = (vram + ((reg[13] << 10) & 0xfc00) + 2);
+		tiles = (vram + (reg[4] << 13));
+	}
+
+	// Wide or narrow?
+	if (reg[12] & 1) {
+		w = 40;
+		xstart = -8;
+	}
+	else {
+		w = 32;
+		xstart = 24;
+	}
+
+	/*
+	 * Lookup the horizontal offset.
+	 * See Charles MacDonald's genvdp.txt for explanation.
+	 */
+	switch (reg[11] & 3) {
+	case 0:
+		// full screen
+		// NOP - pointer in the right place
+		break;
+	case 1:
+		// invalid, but populous uses it
+		hscroll_rec_ptr += ((line & 7) << 2);
+		break;
+	case 2:
+		// per tile
+		hscroll_rec_ptr += ((line & ~7) << 2);
+		break;
+	case 3:
+		// per line
+		hscroll_rec_ptr += (line << 2);
+		break;
+	}
+
+	hscroll_amount = get_word(hscroll_rec_ptr);
+	xoff_mask = xsize - 1;
+	xoff = ((-(hscroll_amount>>3) - 1)<<1) & xoff_mask;
+	where = dest + (xstart + (hscroll_amount & 7));
+
+	/*
+	 * If this is not column vscroll mode, we look up the
+	 * whole screen vertical scroll value once and once only.
+	 */
+	if (two_cell_vscroll == 0)
+		LOOKUP_YSCROLL_REC(plane);
+
+	/*
+	 * Loop cells, we draw 2 more cells than expected (-1 and w) because
+	 * previously off-screen cells can be horizontally scrolled on-screen.
+	 */
+	for (x = -1; (x <= w); x++) {
+		/*
+		 * If we are in 2-cell vscroll mode then lookup the amount by
+		 * which we should scroll this tile.
+		 *
+		 * If we are not in 2-cell vscroll then we looked up the value
+		 * for the whole screen vscroll earlier.
+		 *
+		 * We lookup vscroll values on even x values and this is the
+		 * vscroll value for the next two cells. Note that cell -1 is
+		 * a special case as we never looked up the vscroll value for
+		 * cell -2.
+		 */
+		if ((two_cell_vscroll) && ((x % 2 == 0) || (x == -1))) {
+
+			/*
+			 * Note that the underflow and overflow of the table
+			 * for cell -1 and cell w is intentional.
+			 *
+			 * http://gendev.spritesmind.net/forum/viewtopic.php?t=737&postdays=0&postorder=asc&start=30
+			 */
+			uint8_t cell_index = (uint8_t) x % w;
+			/*
+			 * The records alternate, PLANE A, PLANE B, PLANE A,
+			 * ...
+			 */
+			int vscroll_rec_no = ((2 * (cell_index / 2)) + plane);
+
+			LOOKUP_YSCROLL_REC(vscroll_rec_no);
+		}
+
+		if (plane == 0) {
+			if (reg[17] & 0x80) {
+				// Don't draw where the window will be
+				if (x >= ((reg[17] & 0x1f) << 1))
+					goto skip;
+			}
+			else {
+				// + 1 so scroll layers in Sonic look right
+				if ((x + 1) < ((reg[17] & 0x1f) << 1))
+					goto skip;
+			}
+		}
+		which = get_word(tile_line + xoff);
+
+		// Plane B is drawn first and covers the background.
+		if (plane == 1)
+			draw_tile1_solid(which, scan, where);
+		else
+			draw_tile1(which, scan, where);
+	skip:
+		where += 8;
+		xoff = ((xoff + 2) & xoff_mask);
+	}
 }
 
-inline void md_vdp::draw_plane_front0(int line)
+#undef LOOKUP_YSCROLL_REC
+
+// Decode sprite_order[] into sprite_infos[] and sort it by line into
+// sprite_lines[], entries for a given line are between
+// sprite_lines_start[line] and sprite_lines_start[line + 1].
+inline void md_vdp::sprite_lines_update()
 {
-#define FRONT 1
-#define PLANE 0
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+  uint16_t pos[0x100];
+  int i, l;
+
+  sprite_reg12 = (reg[12] & 3);
+  sprite_frame_end[0] = sprite_frame_end[1] = sprite_count;
+  memset(pos, 0, sizeof(pos));
+  for (i = (sprite_count - 1); (i >= 0); --i)
+    {
+      struct sprite_info& info = sprite_infos[i];
+      int end;
+
+      // First sprites over the frame limits, 64 in H32, 80 in H40.
+      if (sprite_order[i] >= 64)
+	sprite_frame_end[0] = i;
+      if (sprite_order[i] >= 80)
+	sprite_frame_end[1] = i;
+      get_sprite_info(info, sprite_order[i]);
+      info.masking = !(get_word(info.sprite + 6) & 0x1ff);
+      end = (info.y + info.h);
+      if (end > 0x100)
+	end = 0x100;
+      for (l = ((info.y < 0) ? 0 : info.y); (l < end); ++l)
+	++pos[l];
+    }
+  sprite_lines_start[0] = 0;
+  for (l = 0; (l != 0x100); ++l)
+    {
+      sprite_lines_start[(l + 1)] = (sprite_lines_start[l] + pos[l]);
+      pos[l] = sprite_lines_start[l];
+    }
+  for (i = 0; (i != sprite_count); ++i)
+    {
+      const struct sprite_info& info = sprite_infos[i];
+      int end = (info.y + info.h);
+
+      if (end > 0x100)
+	end = 0x100;
+      for (l = ((info.y < 0) ? 0 : info.y); (l < end); ++l)
+	sprite_lines[(pos[l]++)] = i;
+    }
 }
 
-inline void md_vdp::draw_plane_front1(int line)
+// Recalculate the sprite order, if it's dirty
+inline void md_vdp::sprite_order_update()
 {
-#define FRONT 1
-#define PLANE 1
-#include "ras-drawplane.h"
-#undef PLANE
-#undef FRONT
+  unsigned next = 0;
+  // Max number of sprites per frame: 80 in H40, 64 in H32.
+  int max = ((reg[12] & 1) ? 80 : 64);
+
+  if (!((dirt[0x30] & 0x20) || (dirt[0x34] & 1) ||
+	((reg[12] & 3) != sprite_reg12)))
+    return;
+  // Find the sprite base in VRAM
+  sprite_base = vram + (reg[5]<<9);
+  // Order the sprites
+  sprite_count = sprite_order[0] = 0;
+  do {
+    next = sprite_base[(next << 3) + 3];
+    sprite_order[++sprite_count] = next;
+  } while (next && sprite_count < max);
+  // Clean up the dirt
+  dirt[0x30] &= ~0x20; dirt[0x34] &= ~1;
+  sprite_lines_update();
 }
 
 // Allow frame components to be hidden when WITH_DEBUG_VDP is defined.
@@ -1127,14 +956,101 @@ inline void md_vdp::draw_plane_front1(int line)
 #define vdp_hide_if(a, b) (void)(b)
 #endif
 
+// Convert line buffer pixels [start, end) through highpal, into 8, 16 or
+// 32-bit pixels. draw_scanline() picks the version for the bmap's depth.
+template <typename pixel_t>
+void md_vdp::convert_line(unsigned char *out, int start, int end)
+{
+  const uint8_t *src = dest;
+  pixel_t *pixel = (pixel_t *)out;
+  int i;
+
+  for (i = start; (i != end); ++i)
+    pixel[i] = highpal[(src[i] & LINE_INDEX)];
+}
+
+// Same for 24-bit pixels, highpal entries are stored in memory order.
+void md_vdp::convert_line24(unsigned char *out, int start, int end)
+{
+  const uint8_t *src = dest;
+  uint24_t *pixel = (uint24_t *)out;
+  int i;
+
+  for (i = start; (i != end); ++i)
+    u24cpy(&pixel[i], (uint24_t *)&highpal[(src[i] & LINE_INDEX)]);
+}
+
+// Convert CRAM entry "n" to a highpal[] value for depth "bpp"
+static inline uint32_t highpal_entry(int bpp, const uint8_t *cram,
+				     unsigned int n)
+{
+  const uint8_t *c = &cram[(n << 1)];
+
+  switch (bpp)
+    {
+    case 24:
+#ifdef WORDS_BIGENDIAN
+      return (((c[1] & 0x0e) << 28) | ((c[1] & 0xe0) << 16) |
+	      ((c[0] & 0x0e) << 12));
+#else
+      return (((c[1] & 0x0e) << 4) | ((c[1] & 0xe0) << 16) |
+	      ((c[0] & 0x0e) << 12));
+#endif
+    case 32:
+      return (((c[1] & 0x0e) << 20) | ((c[1] & 0xe0) << 8) |
+	      ((c[0] & 0x0e) << 4));
+    case 16:
+      return (((c[1] & 0x0e) << 12) | ((c[1] & 0xe0) << 3) |
+	      ((c[0] & 0x0e) << 1));
+    case 15:
+      return (((c[1] & 0x0e) << 11) | ((c[1] & 0xe0) << 2) |
+	      ((c[0] & 0x0e) << 1));
+    case 8:
+    default:
+      // Let the hardware palette sort it out :P
+      return n;
+    }
+}
+
+// Update highpal[] entries whose CRAM bytes are marked in dirt[0x20..0x2f],
+// or all of them when the depth changes.
+void md_vdp::highpal_update(int bpp)
+{
+  unsigned int i;
+
+  if (bpp != highpal_bpp)
+    {
+      highpal_bpp = bpp;
+      memset(&dirt[0x20], 0xff, 0x10);
+    }
+  // Each dirt byte covers 8 CRAM bytes, 4 entries.
+  for (i = 0; (i != 0x10); ++i)
+    {
+      unsigned int bits = dirt[(0x20 + i)];
+      unsigned int n;
+
+      if (bits == 0)
+	continue;
+      dirt[(0x20 + i)] = 0;
+      for (n = (i << 2); (bits != 0); bits >>= 2, ++n)
+	if (bits & 3)
+	  highpal[n] = highpal_entry(bpp, cram, n);
+    }
+  // Clean up the dirt
+  dirt[0x34] &= ~2;
+}
+
 // The main interface function, to generate a scanline
 void md_vdp::draw_scanline(struct bmap *bits, int line)
 {
-  uint32_t *ptr;
-  int i;
-  // Set the destination in the bmap
+  unsigned char *row;
+  unsigned char *out;
+  // Draw everything into the line buffer, the bmap is only written to by
+  // convert()
   bmap = bits;
-  dest = bits->data + (bits->pitch * (line + 8) + 16);
+  dest = (line_buf + 8);
+  row = bits->data + (bits->pitch * (line + 8) + 16);
+  out = ((bits->dirty != NULL) ? line_out : row);
   // If bytes per pixel hasn't yet been set, do it
   if ((Bpp == 0) || (Bpp != BITS_TO_BYTES(bits->bpp)))
     {
@@ -1142,116 +1058,80 @@ void md_vdp::draw_scanline(struct bmap *bits, int line)
       else if(bits->bpp <= 16) Bpp = 2;
       else if(bits->bpp <= 24) Bpp = 3;
       else		       Bpp = 4;
-      Bpp_times8 = Bpp << 3; // used for tile blitting
-#ifdef WITH_X86_TILES
-      asm_tiles_init(vram, reg, highpal); // pass these values to the asm tiles
-#endif
+      switch (Bpp)
+	{
+	case 1: convert = &md_vdp::convert_line<uint8_t>; break;
+	case 2: convert = &md_vdp::convert_line<uint16_t>; break;
+	case 3: convert = &md_vdp::convert_line24; break;
+	default: convert = &md_vdp::convert_line<uint32_t>; break;
+	}
     }
 
   // If the palette's been changed, update it
-  if(dirt[0x34] & 2)
-    {
-      ptr = highpal;
-      // What color depth are we?
-      switch(bits->bpp)
-        {
-	case 24:
-#ifdef WORDS_BIGENDIAN
-		for (i = 0; (i < 128); i += 2)
-			*ptr++ = (((cram[(i + 1)] & 0x0e) << 28) |
-				  ((cram[(i + 1)] & 0xe0) << 16) |
-				  ((cram[i] & 0x0e) << 12));
-		break;
-#else
-		for (i = 0; (i < 128); i += 2)
-			*ptr++ = (((cram[(i + 1)] & 0x0e) << 4) |
-				  ((cram[(i + 1)] & 0xe0) << 16) |
-				  ((cram[i] & 0x0e) << 12));
-		break;
-#endif
-	case 32:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 20) |
-		     ((cram[i+1]&0xe0) << 8 ) |
-		     ((cram[i]  &0x0e) << 4 );
-	  break;
-	case 16:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 12) |
-		     ((cram[i+1]&0xe0) << 3 ) |
-		     ((cram[i]  &0x0e) << 1 );
-	  break;
-	case 15:
-	  for(i = 0; i < 128; i += 2)
-	    *ptr++ = ((cram[i+1]&0x0e) << 11) |
-		     ((cram[i+1]&0xe0) << 2 ) |
-		     ((cram[i]  &0x0e) << 1 );
-	  break;
-	case 8:
-	default:
-	  // Let the hardware palette sort it out :P
-	  for(i = 0; i < 64; ++i) *ptr++ = i;
-	}
-      // Clean up the dirt
-      dirt[0x34] &= ~2;
-      pal_dirty = 1;
-    }
+  if ((dirt[0x34] & 2) || (bits->bpp != highpal_bpp))
+    highpal_update(bits->bpp);
   // Render the screen if it's turned on
   if(reg[1] & 0x40)
     {
-      // Recalculate the sprite order, if it's dirty
-      if((dirt[0x30] & 0x20) || (dirt[0x34] & 1))
-	{
-	  unsigned next = 0;
-	  // Max number of sprites per frame: 80 in H40, 64 in H32.
-	  int max = ((reg[12] & 1) ? 80 : 64);
-	  // Find the sprite base in VRAM
-	  sprite_base = vram + (reg[5]<<9);
-	  // Order the sprites
-	  sprite_count = sprite_order[0] = 0;
-	  do {
-	    next = sprite_base[(next << 3) + 3];
-	    sprite_order[++sprite_count] = next;
-	  } while (next && sprite_count < max);
-	  // Clean up the dirt
-	  dirt[0x30] &= ~0x20; dirt[0x34] &= ~1;
-	  // Generate overlap mask for sprites with high priority bit
-	  sprite_mask_generate();
-	}
+      tile_cache_update();
+      sprite_order_update();
       // Calculate sprite masking and overflow.
       sprite_masking_overflow(line);
-      // Draw, from the bottom up
-      // Low priority
-      vdp_hide_if(dgen_vdp_hide_plane_b, draw_plane_back1(line));
-      vdp_hide_if(dgen_vdp_hide_plane_a, draw_plane_back0(line));
-      vdp_hide_if(dgen_vdp_hide_plane_w, draw_window(line, 0));
-      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites(line, 0));
-      // High priority
-      vdp_hide_if(dgen_vdp_hide_plane_b, draw_plane_front1(line));
-      vdp_hide_if(dgen_vdp_hide_plane_a, draw_plane_front0(line));
-      vdp_hide_if(dgen_vdp_hide_plane_w, draw_window(line, 1));
-      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites(line, 1));
+      // Draw, from the bottom up. Planes and the window are drawn once,
+      // low priority pixels stay under high priority ones (LINE_PRIO).
+      // Sprites still need two passes for sprite_spans[].
+      vdp_hide_if(dgen_vdp_hide_plane_b, draw_plane<1>(line));
+      vdp_hide_if(dgen_vdp_hide_plane_a, draw_plane<0>(line));
+      vdp_hide_if(dgen_vdp_hide_plane_w, draw_window(line));
+      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites<false>(line));
+      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites<true>(line));
+      // If we're in narrow (256) mode, cut off the messy edges
+      if(!(reg[12] & 1))
+	{
+	  memset(out, 0, (32 * Bpp));
+	  memset((out + (288 * Bpp)), 0, (32 * Bpp));
+	  (this->*convert)(out, 32, 288);
+	}
+      else
+	(this->*convert)(out, 0, 320);
     } else {
       // The display is off, paint it black
-      // Do it a dword at a time
-      unsigned *destl = (unsigned*)dest;
-      for(i = 0; i < (80 * Bpp); ++i) destl[i] = 0;
+      memset(out, 0, (320 * Bpp));
     }
-
-  // If we're in narrow (256) mode, cut off the messy edges
-  if(!(reg[12] & 1))
+  // Only copy lines that have changed when they are tracked
+  if ((out != row) && (memcmp(row, out, (320 * Bpp))))
+    {
+      memcpy(row, out, (320 * Bpp));
+      bits->dirty[line] = 1;
+    }
+#ifdef WITH_DEBUG_VDP
+  if ((reg[1] & 0x40) && (dgen_vdp_sprites_boxing))
     {
-      unsigned *destl = (unsigned*)dest;
-      for(i = 0; i < Bpp_times8; ++i)
-        destl[i] = destl[i + (72 * Bpp)] = 0;
+      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites_boxing(line, 0));
+      vdp_hide_if(dgen_vdp_hide_sprites, draw_sprites_boxing(line, 1));
+      if (bits->dirty != NULL)
+	bits->dirty[line] = 1;
     }
+#endif
+}
+
+// Skipped frames still need the sprite overflow and collision bits
+// draw_scanline() would have set, everything else is left dirty for the
+// next frame that gets drawn.
+void md_vdp::skip_scanline(int line)
+{
+  if (!(reg[1] & 0x40))
+    return;
+  sprite_order_update();
+  sprite_masking_overflow(line);
 }
 
 void md_vdp::draw_pixel(struct bmap *bits, int x, int y, uint32_t rgb)
 {
 	uint8_t *out;
 
-	if ((x < 0) || (x >= bits->w) || (y < 0) || (y >= bits->h))
+	if ((x < 0) || (x >= (bits->w - 16)) ||
+	    (y < 0) || (y >= (bits->h - 16)))
 		return;
 	out = ((bits->data + (bits->pitch * (y + 8) + 16)) +
 	       (x * BITS_TO_BYTES(bits->bpp)));
@@ -113,6 +113,7 @@ RCVAR(dgen_autoload, 0);
 RCVAR(dgen_autosave, 0);
 RCVAR(dgen_autoconf, 1);
 RCVAR(dgen_frameskip, 1);
+RCVAR(dgen_frameskip_fixed, 0);
 RCVAR(dgen_show_carthead, 0);
 RCSTR(dgen_rom_path, "roms"); /* synchronize with romload.c */
 
@@ -120,6 +121,8 @@ RCVAR(dgen_sound, 1);
 RCVAR(dgen_soundrate, 44100);
 RCVAR(dgen_soundsegs, 8);
 RCVAR(dgen_soundsamples, 0);
+RCVAR(dgen_sound_sync, 0);
+RCVAR(dgen_sound_native, 0);
 RCVAR(dgen_volume, 100);
 RCVAR(dgen_mjazz, 0);
 
@@ -158,6 +161,8 @@ RCVAR(dgen_opengl_32bit, 1);
 RCVAR(dgen_opengl_square, 0);
 RCVAR(dgen_doublebuffer, 1);
 RCVAR(dgen_screen_thread, 0);
+RCVAR(dgen_screen_bands, 1); // render threads, 0 for one per CPU
+RCVAR(dgen_filter_threads, 1); // filter stripes, 0 for one per CPU
 RCVAR(dgen_vdp_hide_plane_a, 0);
 RCVAR(dgen_vdp_hide_plane_b, 0);
 RCVAR(dgen_vdp_hide_plane_w, 0);
@@ -759,6 +759,7 @@ struct rc_field rc_fields[RC_FIELDS_SIZE] = {
 	{ "bool_autosave", rc_boolean, &dgen_autosave },
 	{ "bool_autoconf", rc_boolean, &dgen_autoconf },
 	{ "bool_frameskip", rc_boolean, &dgen_frameskip },
+	{ "int_frameskip_fixed", rc_number, &dgen_frameskip_fixed },
 	{ "bool_show_carthead", rc_boolean, &dgen_show_carthead },
 	{ "str_rom_path", rc_rom_path,
 	  (intptr_t *)((void *)&dgen_rom_path) }, // SH
@@ -771,6 +772,8 @@ struct rc_field rc_fields[RC_FIELDS_SIZE] = {
 	{ "int_soundrate", rc_soundrate, &dgen_soundrate }, // SH
 	{ "int_soundsegs", rc_number, &dgen_soundsegs }, // SH
 	{ "int_soundsamples", rc_number, &dgen_soundsamples }, // SH
+	{ "bool_sound_sync", rc_boolean, &dgen_sound_sync }, // SH
+	{ "bool_sound_native", rc_boolean, &dgen_sound_native }, // SH
 	{ "int_volume", rc_number, &dgen_volume },
 	{ "key_volume_inc", rc_keysym, &dgen_volume_inc[RCBK] },
 	{ "joy_volume_inc", rc_joypad, &dgen_volume_inc[RCBJ] },
@@ -812,6 +815,8 @@ struct rc_field rc_fields[RC_FIELDS_SIZE] = {
 	{ "bool_opengl_square", rc_boolean, &dgen_opengl_square }, // SH
 	{ "bool_doublebuffer", rc_boolean, &dgen_doublebuffer }, // SH
 	{ "bool_screen_thread", rc_boolean, &dgen_screen_thread }, // SH
+	{ "int_screen_bands", rc_number, &dgen_screen_bands },
+	{ "int_filter_threads", rc_number, &dgen_filter_threads },
 	{ "bool_joystick", rc_boolean, &dgen_joystick }, // SH
 	{ "int_mouse_delay", rc_number, &dgen_mouse_delay },
 	{ NULL, NULL, NULL }
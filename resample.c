@@ -0,0 +1,202 @@
+/*
+  DGen/SDL
+
+  Fixed-point polyphase resampler for interleaved stereo 16-bit samples.
+
+  Each output sample is the sum of "taps" input samples weighted by a
+  windowed sinc whose cutoff is just below half the lowest of both rates,
+  so that downsampling doesn't alias. Coefficients are precomputed for
+  RESAMPLE_PHASES positions between two input samples, the nearest one is
+  used. The position between two input samples is a 32-bit fraction, so
+  the per-sample loop doesn't need any division.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+
+#define RESAMPLE_PHASES 256
+#define RESAMPLE_ZEROS 8 /* sinc zero crossings on each side */
+#define RESAMPLE_CUTOFF 0.9 /* fraction of the Nyquist frequency */
+#define RESAMPLE_SHIFT 14 /* coefficients precision */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct resample {
+	unsigned int in_rate;
+	unsigned int out_rate;
+	unsigned int step_int; /* input samples per output sample */
+	uint32_t step_frac; /* remainder, in 1/2^32 */
+	unsigned int taps;
+	int16_t *coef; /* (RESAMPLE_PHASES + 1) * taps */
+	int16_t *buf; /* input samples, stereo */
+	unsigned int buf_size; /* buf capacity in samples */
+	unsigned int buf_len; /* samples in buf */
+	unsigned int pos; /* first input sample of the next output */
+	uint32_t frac; /* position between pos and pos + 1, in 1/2^32 */
+};
+
+struct resample *resample_new(unsigned int in_rate, unsigned int out_rate)
+{
+	struct resample *rs;
+	double *h;
+	double cutoff;
+	unsigned int half;
+	unsigned int p;
+
+	if ((in_rate == 0) || (out_rate == 0))
+		return NULL;
+	if ((rs = calloc(1, sizeof(*rs))) == NULL)
+		return NULL;
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->step_int = (in_rate / out_rate);
+	rs->step_frac = ((((uint64_t)(in_rate % out_rate)) << 32) / out_rate);
+	/* Cutoff relative to the input rate's Nyquist frequency. */
+	cutoff = RESAMPLE_CUTOFF;
+	if (out_rate < in_rate)
+		cutoff = ((cutoff * out_rate) / in_rate);
+	half = (unsigned int)ceil(RESAMPLE_ZEROS / cutoff);
+	rs->taps = (half * 2);
+	/* The extra phase is the first one shifted by one input sample, for
+	   positions that round up to it. */
+	rs->coef = malloc(sizeof(*rs->coef) * (RESAMPLE_PHASES + 1) *
+			  rs->taps);
+	h = malloc(sizeof(*h) * rs->taps);
+	if ((rs->coef == NULL) || (h == NULL)) {
+		free(h);
+		free(rs->coef);
+		free(rs);
+		return NULL;
+	}
+	for (p = 0; (p <= RESAMPLE_PHASES); ++p) {
+		int16_t *coef = &rs->coef[(p * rs->taps)];
+		double sum = 0.0;
+		int total = 0;
+		unsigned int j;
+
+		for (j = 0; (j != rs->taps); ++j) {
+			/* Distance from the output sample. */
+			double d = (((half - 1.0) +
+				     ((double)p / RESAMPLE_PHASES)) - j);
+			double x = (d / half);
+			double s = (M_PI * cutoff * d);
+
+			h[j] = ((d == 0.0) ? cutoff : ((cutoff * sin(s)) / s));
+			/* Blackman window. */
+			if (fabs(x) >= 1.0)
+				h[j] = 0.0;
+			else
+				h[j] *= (0.42 + (0.5 * cos(M_PI * x)) +
+					 (0.08 * cos(2.0 * M_PI * x)));
+			sum += h[j];
+		}
+		/* Unity gain for all phases, rounding errors go to the
+		   center tap. */
+		for (j = 0; (j != rs->taps); ++j) {
+			coef[j] = (int16_t)floor(((h[j] / sum) *
+						  (1 << RESAMPLE_SHIFT)) + 0.5);
+			total += coef[j];
+		}
+		coef[(half - 1)] += ((1 << RESAMPLE_SHIFT) - total);
+	}
+	free(h);
+	/* Start with silence, the first output sample is centered on the
+	   first input sample. */
+	rs->buf_len = (half - 1);
+	rs->buf_size = rs->taps;
+	rs->buf = calloc(rs->buf_size, (sizeof(*rs->buf) * 2));
+	if (rs->buf == NULL) {
+		free(rs->coef);
+		free(rs);
+		return NULL;
+	}
+	return rs;
+}
+
+void resample_free(struct resample *rs)
+{
+	if (rs == NULL)
+		return;
+	free(rs->buf);
+	free(rs->coef);
+	free(rs);
+}
+
+int16_t *resample_in(struct resample *rs, unsigned int out_len,
+		     unsigned int *len)
+{
+	unsigned int need = rs->buf_len;
+
+	if (out_len) {
+		--out_len;
+		/* First input sample of the last output, plus its taps. */
+		need = (rs->pos + (rs->step_int * out_len) +
+			(unsigned int)((rs->frac +
+					((uint64_t)rs->step_frac * out_len)) >>
+				       32) + rs->taps);
+		if (need < rs->buf_len)
+			need = rs->buf_len;
+	}
+	if (need > rs->buf_size) {
+		int16_t *buf = realloc(rs->buf, (sizeof(*buf) * 2 * need));
+
+		if (buf == NULL)
+			return NULL;
+		rs->buf = buf;
+		rs->buf_size = need;
+	}
+	*len = (need - rs->buf_len);
+	rs->buf_len = need;
+	return &rs->buf[((need - *len) * 2)];
+}
+
+void resample_out(struct resample *rs, int16_t *out, unsigned int out_len)
+{
+	unsigned int taps = rs->taps;
+	unsigned int pos = rs->pos;
+	uint32_t frac = rs->frac;
+	unsigned int i;
+
+	for (i = 0; (i != out_len); ++i) {
+		const int16_t *x = &rs->buf[(pos * 2)];
+		/* Nearest phase, the top 8 bits of frac rounded. */
+		const int16_t *h = &rs->coef[((((frac >> 23) + 1) >> 1) *
+					      taps)];
+		int32_t l = (1 << (RESAMPLE_SHIFT - 1));
+		int32_t r = (1 << (RESAMPLE_SHIFT - 1));
+		unsigned int j;
+
+		for (j = 0; (j != taps); ++j) {
+			l += (x[0] * h[j]);
+			r += (x[1] * h[j]);
+			x += 2;
+		}
+		l >>= RESAMPLE_SHIFT;
+		r >>= RESAMPLE_SHIFT;
+		/* The filter can overshoot. */
+		if (l > 32767)
+			l = 32767;
+		else if (l < -32768)
+			l = -32768;
+		if (r > 32767)
+			r = 32767;
+		else if (r < -32768)
+			r = -32768;
+		*(out++) = l;
+		*(out++) = r;
+		pos += rs->step_int;
+		if ((uint32_t)(frac + rs->step_frac) < frac)
+			++pos;
+		frac += rs->step_frac;
+	}
+	/* Drop consumed input. */
+	memmove(rs->buf, &rs->buf[(pos * 2)],
+		(sizeof(*rs->buf) * 2 * (rs->buf_len - pos)));
+	rs->buf_len -= pos;
+	rs->pos = 0;
+	rs->frac = frac;
+}
@@ -0,0 +1,42 @@
+/*
+  DGen/SDL
+
+  Fixed-point polyphase resampler for interleaved stereo 16-bit samples.
+*/
+
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+#define RESAMPLE_DECL_BEGIN__ extern "C" {
+#define RESAMPLE_DECL_END__ }
+#else
+#define RESAMPLE_DECL_BEGIN__
+#define RESAMPLE_DECL_END__
+#endif
+
+RESAMPLE_DECL_BEGIN__
+
+struct resample;
+
+/*
+  Only resample_new() uses floating point, to compute the coefficients
+  table. Converting samples is done with integers only.
+*/
+extern struct resample *resample_new(unsigned int in_rate,
+				     unsigned int out_rate);
+extern void resample_free(struct resample *rs);
+/*
+  Return where to write the *len input samples needed to produce out_len
+  output samples with the next resample_out() call, NULL on failure.
+*/
+extern int16_t *resample_in(struct resample *rs, unsigned int out_len,
+			    unsigned int *len);
+extern void resample_out(struct resample *rs, int16_t *out,
+			 unsigned int out_len);
+
+RESAMPLE_DECL_END__
+
+#endif /* RESAMPLE_H_ */
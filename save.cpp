@@ -353,6 +353,7 @@ int md::import_gst(FILE *hand)
 		fm_reset();
 	}
 	z80_st_busreq = (p[1] & 1); /* BUSREQ state */
+	misc_memory_map_z80();
 	memcpy(&tmp, &(*buf)[0x43c], 4);
 	z80_bank68k = le2h32(tmp);
 	/* Z80 RAM (8192 bytes) */
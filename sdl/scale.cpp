@@ -0,0 +1,348 @@
+/**
+ * @file
+ * Integer pixel duplication kernels used by the scale and stretch filters.
+ *
+ * There is a portable version of each kernel, SSE2 and NEON ones are also
+ * built when the compiler supports them and picked at run time by
+ * scale_line_find() depending on what the CPU can do.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define WITH_SSE2_KERNELS
+#include <emmintrin.h>
+#define SSE2_TARGET __attribute__((__target__("sse2")))
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define WITH_NEON_KERNELS
+#include <arm_neon.h>
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#include "scale.h"
+
+#define SCALE_SSE2 0x01
+#define SCALE_NEON 0x02
+
+// Portable versions, the first line is scaled pixel by pixel and copied
+// to the others.
+template <typename uintX_t, unsigned int x_scale>
+static void scale_line_c(uint8_t *dst, unsigned int dst_pitch,
+			 unsigned int rows, const uint8_t *src,
+			 unsigned int width)
+{
+	const uintX_t *in = (const uintX_t *)src;
+	uintX_t *out = (uintX_t *)dst;
+	size_t len = (width * x_scale * sizeof(*out));
+	unsigned int x;
+	unsigned int i;
+
+	for (x = 0; (x != width); ++x) {
+		uintX_t tmp = in[x];
+
+		for (i = 0; (i != x_scale); ++i)
+			*(out++) = tmp;
+	}
+	for (i = 1; (i < rows); ++i)
+		memcpy((dst + (dst_pitch * i)), dst, len);
+}
+
+// Scale the pixels left over by vector kernels, to all lines.
+template <typename uintX_t, unsigned int x_scale>
+static inline void scale_tail(uint8_t *dst, unsigned int dst_pitch,
+			      unsigned int rows, const uint8_t *src,
+			      unsigned int x, unsigned int width)
+{
+	unsigned int i;
+
+	for (i = 0; (i != rows); ++i) {
+		const uintX_t *in = (const uintX_t *)src;
+		uintX_t *out = (uintX_t *)(dst + (dst_pitch * i));
+		unsigned int j;
+		unsigned int k;
+
+		for (j = x; (j != width); ++j)
+			for (k = 0; (k != x_scale); ++k)
+				out[((j * x_scale) + k)] = in[j];
+	}
+}
+
+#ifdef WITH_SSE2_KERNELS
+
+// Store "n" vectors to all lines.
+SSE2_TARGET
+static inline void sse2_store(uint8_t *dst, unsigned int dst_pitch,
+			      unsigned int rows, const __m128i *v,
+			      unsigned int n)
+{
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; (i != rows); ++i, dst += dst_pitch)
+		for (j = 0; (j != n); ++j)
+			_mm_storeu_si128((__m128i *)(dst + (j * 16)), v[j]);
+}
+
+SSE2_TARGET
+static void scale_line_sse2_16_2(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 8) <= width); x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 2)));
+		__m128i v[2];
+
+		v[0] = _mm_unpacklo_epi16(s, s);
+		v[1] = _mm_unpackhi_epi16(s, s);
+		sse2_store((dst + (x * 4)), dst_pitch, rows, v, 2);
+	}
+	scale_tail<uint16_t, 2>(dst, dst_pitch, rows, src, x, width);
+}
+
+// Lanes made of the low half of one and the high half of another 32-bit
+// word come from (x & lo) | (y & hi).
+SSE2_TARGET
+static inline __m128i sse2_merge16(__m128i x, __m128i y)
+{
+	const __m128i lo = _mm_set1_epi32(0x0000ffff);
+
+	return _mm_or_si128(_mm_and_si128(x, lo), _mm_andnot_si128(lo, y));
+}
+
+SSE2_TARGET
+static void scale_line_sse2_16_3(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 8) <= width); x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 2)));
+		// Each 32-bit word holds a pixel twice: a = p0..p3, b = p4..p7
+		__m128i a = _mm_unpacklo_epi16(s, s);
+		__m128i b = _mm_unpackhi_epi16(s, s);
+		__m128i c = _mm_unpacklo_epi64(_mm_srli_si128(a, 8), b);
+		__m128i v[3];
+
+		// p0 p0 p0 p1 p1 p1 p2 p2
+		v[0] = sse2_merge16(_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 1, 0, 0)),
+				    _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 1, 1, 0)));
+		// p2 p3 p3 p3 p4 p4 p4 p5
+		v[1] = sse2_merge16(_mm_shuffle_epi32(c, _MM_SHUFFLE(2, 2, 1, 0)),
+				    _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 2, 1, 1)));
+		// p5 p5 p6 p6 p6 p7 p7 p7
+		v[2] = sse2_merge16(_mm_shuffle_epi32(b, _MM_SHUFFLE(3, 2, 2, 1)),
+				    _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 1)));
+		sse2_store((dst + (x * 6)), dst_pitch, rows, v, 3);
+	}
+	scale_tail<uint16_t, 3>(dst, dst_pitch, rows, src, x, width);
+}
+
+SSE2_TARGET
+static void scale_line_sse2_16_4(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 8) <= width); x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 2)));
+		__m128i a = _mm_unpacklo_epi16(s, s);
+		__m128i b = _mm_unpackhi_epi16(s, s);
+		__m128i v[4];
+
+		v[0] = _mm_unpacklo_epi32(a, a);
+		v[1] = _mm_unpackhi_epi32(a, a);
+		v[2] = _mm_unpacklo_epi32(b, b);
+		v[3] = _mm_unpackhi_epi32(b, b);
+		sse2_store((dst + (x * 8)), dst_pitch, rows, v, 4);
+	}
+	scale_tail<uint16_t, 4>(dst, dst_pitch, rows, src, x, width);
+}
+
+SSE2_TARGET
+static void scale_line_sse2_32_2(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 4) <= width); x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 4)));
+		__m128i v[2];
+
+		v[0] = _mm_unpacklo_epi32(s, s);
+		v[1] = _mm_unpackhi_epi32(s, s);
+		sse2_store((dst + (x * 8)), dst_pitch, rows, v, 2);
+	}
+	scale_tail<uint32_t, 2>(dst, dst_pitch, rows, src, x, width);
+}
+
+SSE2_TARGET
+static void scale_line_sse2_32_3(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 4) <= width); x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 4)));
+		__m128i v[3];
+
+		v[0] = _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 0, 0));
+		v[1] = _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 2, 1, 1));
+		v[2] = _mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 2));
+		sse2_store((dst + (x * 12)), dst_pitch, rows, v, 3);
+	}
+	scale_tail<uint32_t, 3>(dst, dst_pitch, rows, src, x, width);
+}
+
+SSE2_TARGET
+static void scale_line_sse2_32_4(uint8_t *dst, unsigned int dst_pitch,
+				 unsigned int rows, const uint8_t *src,
+				 unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; ((x + 4) <= width); x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + (x * 4)));
+		__m128i v[4];
+
+		v[0] = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 0, 0, 0));
+		v[1] = _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 1, 1, 1));
+		v[2] = _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 2, 2, 2));
+		v[3] = _mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 3));
+		sse2_store((dst + (x * 16)), dst_pitch, rows, v, 4);
+	}
+	scale_tail<uint32_t, 4>(dst, dst_pitch, rows, src, x, width);
+}
+
+#endif // WITH_SSE2_KERNELS
+
+#ifdef WITH_NEON_KERNELS
+
+// Interleaving stores of the same vector do the duplication.
+#define NEON_KERNEL(bits, lanes, n)					\
+static void scale_line_neon_ ## bits ## _ ## n(uint8_t *dst,		\
+					       unsigned int dst_pitch,	\
+					       unsigned int rows,	\
+					       const uint8_t *src,	\
+					       unsigned int width)	\
+{									\
+	unsigned int x;							\
+									\
+	for (x = 0; ((x + lanes) <= width); x += lanes) {		\
+		uint ## bits ## x ## lanes ## _t s =			\
+			vld1q_u ## bits((const uint ## bits ## _t *)	\
+					(src + (x * (bits / 8))));	\
+		uint ## bits ## x ## lanes ## x ## n ## _t v;		\
+		uint8_t *out = (dst + (x * n * (bits / 8)));		\
+		unsigned int i;						\
+									\
+		for (i = 0; (i != n); ++i)				\
+			v.val[i] = s;					\
+		for (i = 0; (i != rows); ++i, out += dst_pitch)		\
+			vst ## n ## q_u ## bits((uint ## bits ## _t *)out, v); \
+	}								\
+	scale_tail<uint ## bits ## _t, n>(dst, dst_pitch, rows, src, x, \
+					 width);			\
+}
+
+NEON_KERNEL(16, 8, 2)
+NEON_KERNEL(16, 8, 3)
+NEON_KERNEL(16, 8, 4)
+NEON_KERNEL(32, 4, 2)
+NEON_KERNEL(32, 4, 3)
+NEON_KERNEL(32, 4, 4)
+
+#endif // WITH_NEON_KERNELS
+
+static const struct {
+	unsigned int Bpp;
+	unsigned int x_scale;
+	unsigned int caps; // required SCALE_* flags
+	const char *name;
+	scale_line_t *func;
+} scale_line_list[] = {
+	// Best versions first.
+#ifdef WITH_SSE2_KERNELS
+	{ 2, 2, SCALE_SSE2, "sse2", scale_line_sse2_16_2 },
+	{ 2, 3, SCALE_SSE2, "sse2", scale_line_sse2_16_3 },
+	{ 2, 4, SCALE_SSE2, "sse2", scale_line_sse2_16_4 },
+	{ 4, 2, SCALE_SSE2, "sse2", scale_line_sse2_32_2 },
+	{ 4, 3, SCALE_SSE2, "sse2", scale_line_sse2_32_3 },
+	{ 4, 4, SCALE_SSE2, "sse2", scale_line_sse2_32_4 },
+#endif
+#ifdef WITH_NEON_KERNELS
+	{ 2, 2, SCALE_NEON, "neon", scale_line_neon_16_2 },
+	{ 2, 3, SCALE_NEON, "neon", scale_line_neon_16_3 },
+	{ 2, 4, SCALE_NEON, "neon", scale_line_neon_16_4 },
+	{ 4, 2, SCALE_NEON, "neon", scale_line_neon_32_2 },
+	{ 4, 3, SCALE_NEON, "neon", scale_line_neon_32_3 },
+	{ 4, 4, SCALE_NEON, "neon", scale_line_neon_32_4 },
+#endif
+	{ 2, 1, 0, "c", scale_line_c<uint16_t, 1> },
+	{ 2, 2, 0, "c", scale_line_c<uint16_t, 2> },
+	{ 2, 3, 0, "c", scale_line_c<uint16_t, 3> },
+	{ 2, 4, 0, "c", scale_line_c<uint16_t, 4> },
+	{ 4, 1, 0, "c", scale_line_c<uint32_t, 1> },
+	{ 4, 2, 0, "c", scale_line_c<uint32_t, 2> },
+	{ 4, 3, 0, "c", scale_line_c<uint32_t, 3> },
+	{ 4, 4, 0, "c", scale_line_c<uint32_t, 4> },
+};
+
+/**
+ * Return what the CPU supports among SCALE_* flags.
+ */
+static unsigned int scale_caps()
+{
+	unsigned int caps = 0;
+
+#ifdef WITH_SSE2_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		caps |= SCALE_SSE2;
+#endif
+#ifdef WITH_NEON_KERNELS
+#if defined(__arm__) && defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		caps |= SCALE_NEON;
+#else
+	caps |= SCALE_NEON;
+#endif
+#endif
+	return caps;
+}
+
+/**
+ * Find the best kernel for a given depth and horizontal scale factor.
+ * @param Bpp Bytes per pixel.
+ * @param x_scale Horizontal scale factor.
+ * @param[out] name Kernel version ("c", "sse2", "neon"), may be NULL.
+ * @return Kernel or NULL if there isn't any.
+ */
+scale_line_t *scale_line_find(unsigned int Bpp, unsigned int x_scale,
+			      const char **name)
+{
+	static unsigned int caps = scale_caps();
+	size_t i;
+
+	for (i = 0; (i != (sizeof(scale_line_list) /
+			   sizeof(scale_line_list[0]))); ++i) {
+		if ((scale_line_list[i].Bpp != Bpp) ||
+		    (scale_line_list[i].x_scale != x_scale) ||
+		    ((scale_line_list[i].caps & caps) !=
+		     scale_line_list[i].caps))
+			continue;
+		if (name != NULL)
+			*name = scale_line_list[i].name;
+		return scale_line_list[i].func;
+	}
+	return NULL;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file
+ * Integer pixel duplication kernels used by the scale and stretch filters.
+ */
+
+#ifndef SCALE_H_
+#define SCALE_H_
+
+#include <stdint.h>
+
+/**
+ * Scale a line horizontally by a fixed factor and write it to several
+ * consecutive lines.
+ * @param[out] dst First destination line.
+ * @param dst_pitch Number of bytes per destination line.
+ * @param rows Number of destination lines to write (at least 1).
+ * @param[in] src Source line.
+ * @param width Number of source pixels.
+ */
+typedef void scale_line_t(uint8_t *dst, unsigned int dst_pitch,
+			  unsigned int rows, const uint8_t *src,
+			  unsigned int width);
+
+extern scale_line_t *scale_line_find(unsigned int Bpp, unsigned int x_scale,
+				     const char **name);
+
+#endif /* SCALE_H_ */
@@ -13,6 +13,9 @@
 #include <errno.h>
 #include <ctype.h>
 #include <assert.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 #include <SDL.h>
 #include <SDL_audio.h>
 
@@ -24,6 +27,7 @@
 #include "pd.h"
 #include "system.h"
 #include "romload.h"
+#include "scale.h"
 
 /// Number of microseconds to sustain messages
 #define MESSAGE_LIFE 3000000
@@ -102,12 +106,15 @@ static void screen_update_once()
 	SDL_Flip(screen.surface);
 }
 
+static bool screen_dirty; ///< screen.buf changed outside of mdscr_dirty[]
+
 /**
  * Call this after writing into screen.buf.
  */
 static void screen_update()
 {
 		screen_update_once();
+		screen_dirty = false;
 }
 
 /**
@@ -119,6 +126,7 @@ static void screen_clear()
 		return;
 	memset(screen.buf.u8, 0, (screen.pitch * screen.height));
 	screen_unlock();
+	screen_dirty = true;
 }
 
 // Bad hack- extern slot etc. from main.cpp so we can save/load states
@@ -128,24 +136,101 @@ void md_load(md &megad);
 
 // Define externed variables
 struct bmap mdscr;
+static bool mdscr_direct; ///< mdscr.data points into screen.buf
+static unsigned int mdscr_y_off; ///< first screen.buf line when direct
+static uint8_t mdscr_dirty[PAL_VBLANK]; ///< mdscr.dirty when direct
+
+/**
+ * Push the lines the VDP changed to the display when it draws into
+ * screen.buf directly. Everything is updated when most of them did or when
+ * something else touched screen.buf.
+ */
+static void screen_update_lines()
+{
+	SDL_Rect rect[((PAL_VBLANK + 1) / 2)];
+	unsigned int rects = 0;
+	unsigned int lines = 0;
+	unsigned int y;
+
+	for (y = 0; (y != video.height); ++y) {
+		if (mdscr_dirty[y] == 0)
+			continue;
+		mdscr_dirty[y] = 0;
+		++lines;
+		if ((rects != 0) &&
+		    ((unsigned int)(rect[(rects - 1)].y +
+				    rect[(rects - 1)].h) ==
+		     (mdscr_y_off + y))) {
+			++rect[(rects - 1)].h;
+			continue;
+		}
+		rect[rects].x = 0;
+		rect[rects].y = (mdscr_y_off + y);
+		rect[rects].w = video.width;
+		rect[rects].h = 1;
+		++rects;
+	}
+	if ((screen_dirty) || (lines > ((video.height * 3) / 4)))
+		screen_update();
+	else if (rects != 0)
+		SDL_UpdateRects(screen.surface, rects, rect);
+}
 unsigned char *mdpal = NULL;
 struct sndinfo sndi;
 const char *pd_options =
 	"fX:Y:S:G:";
 
 /// Circular buffer and related functions.
+/// It has a single writer and a single reader which can be different
+/// threads, neither of them ever waits for the other. Indices keep
+/// increasing and wrap around naturally, storage size is a power of two.
 typedef struct {
-	size_t i; ///< data start index
-	size_t s; ///< data size
-	size_t size; ///< buffer size
+	size_t head; ///< write index, only modified by the writer
+	size_t tail; ///< read index, only modified by the reader
+	size_t size; ///< storage size, a power of two
+	size_t max; ///< maximum number of bytes to keep
+	unsigned long overruns; ///< writes truncated because it was full
+	unsigned long underruns; ///< reads truncated because it was empty
 	union {
 		uint8_t *u8;
 		int16_t *i16;
 	} data; ///< storage
 } cbuf_t;
 
+/**
+ * Allocate circular buffer storage.
+ * @param[out] cbuf Circular buffer.
+ * @param max Maximum number of bytes to keep.
+ * @return Nonzero on success.
+ */
+int cbuf_init(cbuf_t *cbuf, size_t max)
+{
+	size_t size;
+
+	for (size = 1; (size < max); size <<= 1)
+		;
+	memset(cbuf, 0, sizeof(*cbuf));
+	if ((cbuf->data.u8 = (uint8_t *)calloc(1, size)) == NULL)
+		return 0;
+	cbuf->size = size;
+	cbuf->max = max;
+	return 1;
+}
+
+/**
+ * Number of bytes currently stored.
+ * @param[in] cbuf Circular buffer.
+ * @return Number of bytes.
+ */
+size_t cbuf_fill(const cbuf_t *cbuf)
+{
+	return (__atomic_load_n(&cbuf->head, __ATOMIC_ACQUIRE) -
+		__atomic_load_n(&cbuf->tail, __ATOMIC_ACQUIRE));
+}
+
 /**
  * Write/copy data into a circular buffer.
+ * What doesn't fit is dropped and counted as an overrun.
  * @param[in,out] cbuf Destination buffer.
  * @param[in] src Buffer to copy from.
  * @param size Size of src.
@@ -153,22 +238,17 @@ typedef struct {
  */
 size_t cbuf_write(cbuf_t *cbuf, uint8_t *src, size_t size)
 {
-	size_t j;
-	size_t k;
+	size_t head = cbuf->head;
+	size_t tail = __atomic_load_n(&cbuf->tail, __ATOMIC_ACQUIRE);
+	size_t room = (cbuf->max - (head - tail));
+	size_t j = (head & (cbuf->size - 1));
+	size_t k = (cbuf->size - j);
 
-	if (size > cbuf->size) {
-		src += (size - cbuf->size);
-		size = cbuf->size;
-	}
-	k = (cbuf->size - cbuf->s);
-	j = ((cbuf->i + cbuf->s) % cbuf->size);
-	if (size > k) {
-		cbuf->i = ((cbuf->i + (size - k)) % cbuf->size);
-		cbuf->s = cbuf->size;
+	if (size > room) {
+		size = room;
+		__atomic_store_n(&cbuf->overruns, (cbuf->overruns + 1),
+				 __ATOMIC_RELAXED);
 	}
-	else
-		cbuf->s += size;
-	k = (cbuf->size - j);
 	if (k >= size) {
 		memcpy(&cbuf->data.u8[j], src, size);
 	}
@@ -176,11 +256,13 @@ size_t cbuf_write(cbuf_t *cbuf, uint8_t *src, size_t size)
 		memcpy(&cbuf->data.u8[j], src, k);
 		memcpy(&cbuf->data.u8[0], &src[k], (size - k));
 	}
+	__atomic_store_n(&cbuf->head, (head + size), __ATOMIC_RELEASE);
 	return size;
 }
 
 /**
  * Read bytes out of a circular buffer.
+ * Reading less than requested is counted as an underrun.
  * @param[out] dst Destination buffer.
  * @param[in,out] cbuf Circular buffer to read from.
  * @param size Maximum number of bytes to copy to dst.
@@ -188,18 +270,23 @@ size_t cbuf_write(cbuf_t *cbuf, uint8_t *src, size_t size)
  */
 size_t cbuf_read(uint8_t *dst, cbuf_t *cbuf, size_t size)
 {
-	if (size > cbuf->s)
-		size = cbuf->s;
-	if ((cbuf->i + size) > cbuf->size) {
-		size_t k = (cbuf->size - cbuf->i);
+	size_t tail = cbuf->tail;
+	size_t head = __atomic_load_n(&cbuf->head, __ATOMIC_ACQUIRE);
+	size_t i = (tail & (cbuf->size - 1));
+	size_t k = (cbuf->size - i);
 
-		memcpy(&dst[0], &cbuf->data.u8[(cbuf->i)], k);
+	if (size > (head - tail)) {
+		size = (head - tail);
+		__atomic_store_n(&cbuf->underruns, (cbuf->underruns + 1),
+				 __ATOMIC_RELAXED);
+	}
+	if (size > k) {
+		memcpy(&dst[0], &cbuf->data.u8[i], k);
 		memcpy(&dst[k], &cbuf->data.u8[0], (size - k));
 	}
 	else
-		memcpy(&dst[0], &cbuf->data.u8[(cbuf->i)], size);
-	cbuf->i = ((cbuf->i + size) % cbuf->size);
-	cbuf->s -= size;
+		memcpy(&dst[0], &cbuf->data.u8[i], size);
+	__atomic_store_n(&cbuf->tail, (tail + size), __ATOMIC_RELEASE);
 	return size;
 }
 
@@ -208,6 +295,9 @@ static struct {
 	unsigned int rate; ///< samples rate
 	unsigned int samples; ///< number of samples required by the callback
 	cbuf_t cbuf; ///< circular buffer
+	int16_t *sync_lr; ///< resampled sndi for dgen_sound_sync
+	unsigned int sync_max; ///< sync_lr size in samples
+	uint32_t sync_frac; ///< fraction of sample carried over (16.16)
 } sound;
 
 /// Messages
@@ -366,6 +456,14 @@ struct filter_data {
 	void *data; ///< Filter-specific data.
 	bool updated:1; ///< Filter updated data to match its output.
 	bool failed:1; ///< Filter failed.
+	/**
+	 * Input lines to process, from first up to end (excluded). Output
+	 * is only written for these, other stripes of the same frame may be
+	 * processed at the same time by other threads. All input lines can
+	 * be read, the previous filter is done with them.
+	 */
+	unsigned int first;
+	unsigned int end;
 };
 
 typedef void filter_func_t(const struct filter_data *in,
@@ -377,6 +475,7 @@ struct filter {
 	bool safe:1; ///< Output buffer can be the same as input.
 	bool ctv:1; ///< Part of the CTV filters set.
 	bool resize:1; ///< Filter resizes input.
+	bool rows:1; ///< Filter reads neighboring input lines.
 };
 
 static filter_func_t filter_scale;
@@ -384,8 +483,8 @@ static filter_func_t filter_off;
 static filter_func_t filter_stretch;
 
 static const struct filter filters_available[] = {
-	{ "stretch", filter_stretch, false, false, true },
-	{ "scale", filter_scale, false, false, true },
+	{ "stretch", filter_stretch, false, false, true, false },
+	{ "scale", filter_scale, false, false, true, false },
 };
 
 static unsigned int filters_stack_size;
@@ -429,6 +528,8 @@ static void filters_stack_update()
 		NULL,
 		false,
 		false,
+		0,
+		0,
 	};
 	struct filter_data out_fd = {
 		{ screen.buf.u8 },
@@ -438,6 +539,8 @@ static void filters_stack_update()
 		NULL,
 		false,
 		false,
+		0,
+		0,
 	};
 	struct filter_data *prev_fd;
 
@@ -877,6 +980,16 @@ error:
 	fclose(fp);
 }
 
+/**
+ * Return the number of microseconds elapsed since an unspecified time.
+ * SDL timer based since gettimeofday() isn't reliable on every target,
+ * millisecond resolution is enough for frame timing.
+ */
+unsigned long pd_usecs(void)
+{
+	return ((unsigned long)SDL_GetTicks() * 1000);
+}
+
 /**
  * SDL flags help.
  */
@@ -975,9 +1088,11 @@ static void filter_off(const struct filter_data *in, struct filter_data *out)
 		out->height = height;
 		out->updated = true;
 	}
-	in_buf = in->buf.u8;
-	out_buf = out->buf.u8;
-	for (line = 0; (line != height); ++line) {
+	if (in->end < height)
+		height = in->end;
+	in_buf = (in->buf.u8 + (in->pitch * in->first));
+	out_buf = (out->buf.u8 + (out->pitch * in->first));
+	for (line = in->first; (line < height); ++line) {
 		memcpy(out_buf, in_buf, (out->width * screen.Bpp));
 		in_buf += in->pitch;
 		out_buf += out->pitch;
@@ -990,8 +1105,34 @@ struct filter_scale_data {
 	unsigned int x_scale;
 	unsigned int y_scale;
 	filter_func_t *filter;
+	scale_line_t *line;
 };
 
+// Same thing using a kernel from scale.cpp.
+static void filter_scale_line(const struct filter_data *in,
+			      struct filter_data *out)
+{
+	struct filter_scale_data *data =
+		(struct filter_scale_data *)out->data;
+	scale_line_t *line = data->line;
+	uint8_t *dst = out->buf.u8;
+	unsigned int dst_pitch = out->pitch;
+	const uint8_t *src = in->buf.u8;
+	unsigned int src_pitch = in->pitch;
+	unsigned int width = in->width;
+	unsigned int y_scale = data->y_scale;
+	unsigned int height = in->end;
+	unsigned int y = in->first;
+
+	dst += (dst_pitch * y_scale * y);
+	src += (src_pitch * y);
+	for (; (y != height); ++y) {
+		(*line)(dst, dst_pitch, y_scale, src, width);
+		dst += (dst_pitch * y_scale);
+		src += src_pitch;
+	}
+}
+
 template <typename uintX_t>
 static void filter_scale_X(const struct filter_data *in,
 			   struct filter_data *out)
@@ -1005,10 +1146,12 @@ static void filter_scale_X(const struct filter_data *in,
 	unsigned int width = in->width;
 	unsigned int x_scale = data->x_scale;
 	unsigned int y_scale = data->y_scale;
-	unsigned int height = in->height;
-	unsigned int y;
+	unsigned int height = in->end;
+	unsigned int y = in->first;
 
-	for (y = 0; (y != height); ++y) {
+	dst = (uintX_t *)((uint8_t *)dst + (dst_pitch * y_scale * y));
+	src = (uintX_t *)((uint8_t *)src + (src_pitch * y));
+	for (; (y != height); ++y) {
 		uintX_t *out = dst;
 		unsigned int i;
 		unsigned int x;
@@ -1042,10 +1185,12 @@ static void filter_scale_3(const struct filter_data *in,
 	unsigned int width = in->width;
 	unsigned int x_scale = data->x_scale;
 	unsigned int y_scale = data->y_scale;
-	unsigned int height = in->height;
-	unsigned int y;
+	unsigned int height = in->end;
+	unsigned int y = in->first;
 
-	for (y = 0; (y != height); ++y) {
+	dst = (uint24_t *)((uint8_t *)dst + (dst_pitch * y_scale * y));
+	src = (uint24_t *)((uint8_t *)src + (src_pitch * y));
+	for (; (y != height); ++y) {
 		uint24_t *out = dst;
 		unsigned int i;
 		unsigned int x;
@@ -1093,6 +1238,8 @@ static void filter_scale(const struct filter_data *in,
 	unsigned int x_scale;
 	unsigned int y_scale;
 	filter_func_t *filter;
+	scale_line_t *line;
+	const char *name;
 	unsigned int i;
 
 	if (out->failed == true) {
@@ -1137,16 +1284,25 @@ static void filter_scale(const struct filter_data *in,
 		out->failed = true;
 		goto failed;
 	}
-	DEBUG(("using %u Bpp function to scale by %ux%u",
-	       screen.Bpp, x_scale, y_scale));
+	filter = scale_mode[i].func;
+	// Use a line kernel for this depth and factor if there is one.
+	line = scale_line_find(screen.Bpp, x_scale, &name);
+	if (line != NULL) {
+		filter = filter_scale_line;
+		DEBUG(("using %u Bpp %s kernel to scale by %ux%u",
+		       screen.Bpp, name, x_scale, y_scale));
+	}
+	else
+		DEBUG(("using %u Bpp function to scale by %ux%u",
+		       screen.Bpp, x_scale, y_scale));
 	data = (struct filter_scale_data *)malloc(sizeof(*data));
 	if (data == NULL) {
 		DEBUG(("allocation failure"));
 		out->failed = true;
 		goto failed;
 	}
-	filter = scale_mode[i].func;
 	data->filter = filter;
+	data->line = line;
 	data->x_scale = x_scale;
 	data->y_scale = y_scale;
 	// Center output.
@@ -1165,8 +1321,40 @@ struct filter_stretch_data {
 	uint8_t *h_table;
 	uint8_t *v_table;
 	filter_func_t *filter;
+	scale_line_t *line;
 };
 
+// When all pixels are repeated the same number of times horizontally, a
+// kernel from scale.cpp does the whole line.
+static void filter_stretch_line(const struct filter_data *in,
+				struct filter_data *out)
+{
+	struct filter_stretch_data *data =
+		(struct filter_stretch_data *)out->data;
+	uint8_t *v_table = data->v_table;
+	scale_line_t *line = data->line;
+	uint8_t *dst = out->buf.u8;
+	unsigned int dst_pitch = out->pitch;
+	const uint8_t *src = in->buf.u8;
+	unsigned int src_pitch = in->pitch;
+	unsigned int src_w = in->width;
+	unsigned int src_h = in->end;
+	unsigned int src_y;
+
+	for (src_y = 0; (src_y != in->first); ++src_y)
+		dst += (dst_pitch * v_table[src_y]);
+	src += (src_pitch * src_y);
+	for (; (src_y != src_h); ++src_y) {
+		uint8_t v_repeat = v_table[src_y];
+
+		if (v_repeat) {
+			(*line)(dst, dst_pitch, v_repeat, src, src_w);
+			dst += (dst_pitch * v_repeat);
+		}
+		src += src_pitch;
+	}
+}
+
 template <typename uintX_t>
 static void filter_stretch_X(const struct filter_data *in,
 			     struct filter_data *out)
@@ -1181,12 +1369,15 @@ static void filter_stretch_X(const struct filter_data *in,
 	uintX_t *src = (uintX_t *)in->buf.u8;
 	unsigned int src_pitch = in->pitch;
 	unsigned int src_w = in->width;
-	unsigned int src_h = in->height;
+	unsigned int src_h = in->end;
 	unsigned int src_y;
 
 	dst_pitch /= sizeof(*dst);
 	src_pitch /= sizeof(*src);
-	for (src_y = 0; (src_y != src_h); ++src_y) {
+	for (src_y = 0; (src_y != in->first); ++src_y)
+		dst += (dst_pitch * v_table[src_y]);
+	src += (src_pitch * src_y);
+	for (; (src_y != src_h); ++src_y) {
 		uint8_t v_repeat = v_table[src_y];
 		unsigned int src_x;
 		unsigned int dst_x;
@@ -1225,12 +1416,15 @@ static void filter_stretch_3(const struct filter_data *in,
 	uint24_t *src = in->buf.u24;
 	unsigned int src_pitch = in->pitch;
 	unsigned int src_w = in->width;
-	unsigned int src_h = in->height;
+	unsigned int src_h = in->end;
 	unsigned int src_y;
 
 	dst_pitch /= sizeof(*dst);
 	src_pitch /= sizeof(*src);
-	for (src_y = 0; (src_y != src_h); ++src_y) {
+	for (src_y = 0; (src_y != in->first); ++src_y)
+		dst += (dst_pitch * v_table[src_y]);
+	src += (src_pitch * src_y);
+	for (; (src_y != src_h); ++src_y) {
 		uint8_t v_repeat = v_table[src_y];
 		unsigned int src_x;
 		unsigned int dst_x;
@@ -1285,6 +1479,7 @@ static void filter_stretch(const struct filter_data *in,
 	unsigned int src_x;
 	unsigned int src_y;
 	filter_func_t *filter;
+	const char *name;
 	unsigned int i;
 
 	if (out->failed == true) {
@@ -1372,6 +1567,18 @@ static void filter_stretch(const struct filter_data *in,
 		if (src_y < src_h)
 			++data->v_table[src_y];
 	}
+	// Integer horizontal ratios can use a line kernel.
+	for (src_x = 1; (src_x < src_w); ++src_x)
+		if (data->h_table[src_x] != data->h_table[0])
+			break;
+	if ((src_x == src_w) &&
+	    ((data->line = scale_line_find(screen.Bpp, data->h_table[0],
+					   &name)) != NULL)) {
+		DEBUG(("using %u Bpp %s kernel to stretch by %u horizontally",
+		       screen.Bpp, name, data->h_table[0]));
+		filter = filter_stretch_line;
+		data->filter = filter;
+	}
 	// Center output.
 	dst_x = ((out->width - dst_w) / 2);
 	dst_y = ((out->height - dst_h) / 2);
@@ -1415,6 +1622,29 @@ prompt_cmd_calibrate(class md&, unsigned int n_args, const char** args)
 	return (CMD_OK | CMD_MSG);
 }
 
+/**
+ * Check whether the VDP can draw directly into screen.buf. The surface must
+ * stay at the same place without locking and filters must have nothing to
+ * do but copy mdscr, which is the case at 1x with the default filter when
+ * the picture is as wide as the screen (nspire).
+ * @return True if mdscr can point into screen.buf.
+ */
+static bool mdscr_direct_possible()
+{
+	unsigned int height = (screen.height - screen.info_height);
+
+	if ((SDL_MUSTLOCK(screen.surface)) ||
+	    (screen.surface->flags & SDL_DOUBLEBUF) ||
+	    (filters_stack_size > 1) ||
+	    ((filters_stack_size == 1) && (!filters_stack_default)) ||
+	    (screen.width != video.width) ||
+	    (height < video.height))
+		return false;
+	// filter_stretch() keeps the aspect ratio by not stretching at all,
+	// otherwise it would fill the whole height.
+	return ((height == video.height) || (dgen_aspect));
+}
+
 /**
  * Initialize screen.
  *
@@ -1521,15 +1751,38 @@ static int screen_init(unsigned int width, unsigned int height)
 	screen = scrtmp;
 	// Set up the Mega Drive screen.
 	// Could not be done earlier because bpp was unknown.
-	if ((mdscr.data == NULL) ||
-	    ((unsigned int)mdscr.bpp != screen.bpp) ||
-	    ((unsigned int)mdscr.w != (video.width + 16)) ||
-	    ((unsigned int)mdscr.h != (video.height + 16))) {
+	if (mdscr_direct_possible()) {
+		unsigned int y_off = (((screen.height - screen.info_height) -
+				       video.height) / 2);
+
+		if (!mdscr_direct)
+			free(mdscr.data);
+		mdscr_direct = true;
+		mdscr.w = (video.width + 16);
+		mdscr.h = (video.height + 16);
+		mdscr.pitch = screen.pitch;
+		mdscr.bpp = screen.bpp;
+		// Centered like filter_off() would, the guard band is never
+		// accessed and ends up outside of the surface.
+		mdscr.data = (screen.buf.u8 + (screen.pitch * y_off) -
+			      (screen.pitch * 8) - 16);
+		// Only changed lines are written and pushed to the display.
+		mdscr.dirty = mdscr_dirty;
+		mdscr_y_off = y_off;
+	}
+	else if ((mdscr_direct) ||
+		 (mdscr.data == NULL) ||
+		 ((unsigned int)mdscr.bpp != screen.bpp) ||
+		 ((unsigned int)mdscr.w != (video.width + 16)) ||
+		 ((unsigned int)mdscr.h != (video.height + 16))) {
+		if (!mdscr_direct)
+			free(mdscr.data);
+		mdscr_direct = false;
+		mdscr.dirty = NULL;
 		mdscr.w = (video.width + 16);
 		mdscr.h = (video.height + 16);
 		mdscr.pitch = (mdscr.w * screen.Bpp);
 		mdscr.bpp = screen.bpp;
-		free(mdscr.data);
 		mdscr.data = (uint8_t *)calloc(mdscr.h, mdscr.pitch);
 		if (mdscr.data == NULL) {
 			// Cannot recover. Clean up and bail out.
@@ -1682,6 +1935,182 @@ void pd_graphics_palette_update()
 		SDL_SetColors(screen.surface, screen.color, 0, 64);
 }
 
+#ifdef WITH_THREADS
+
+// Filters run in horizontal stripes, one per thread. The main thread does
+// the first stripe while workers do the others, then waits for them before
+// moving to the next filter.
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // job changed or quit
+	pthread_cond_t done; // busy reached 0
+	unsigned int job; // incremented for each filter run
+	unsigned int busy; // number of workers still running it
+	bool quit;
+	const struct filter *f;
+	const struct filter_data *fd; // input, output is the next one
+	unsigned int stripes; // number of workers + 1
+	pthread_t thread[15];
+} filters_pool;
+
+// Process stripe "n" of filters_pool.stripes with filter "f". Output
+// data is a copy since it has already been initialized.
+static void filters_stripe(const struct filter *f,
+			   const struct filter_data *fd, unsigned int n,
+			   unsigned int stripes)
+{
+	struct filter_data in = fd[0];
+	struct filter_data out = fd[1];
+
+	in.first = ((in.height * n) / stripes);
+	in.end = ((in.height * (n + 1)) / stripes);
+	f->func(&in, &out);
+}
+
+static void *filters_thread(void *arg)
+{
+	unsigned int n = (uintptr_t)arg;
+	unsigned int job = 0;
+
+	pthread_mutex_lock(&filters_pool.mutex);
+	while (1) {
+		const struct filter *f;
+		const struct filter_data *fd;
+		unsigned int stripes;
+
+		while ((filters_pool.job == job) && (!filters_pool.quit))
+			pthread_cond_wait(&filters_pool.cond,
+					  &filters_pool.mutex);
+		if (filters_pool.quit)
+			break;
+		job = filters_pool.job;
+		f = filters_pool.f;
+		fd = filters_pool.fd;
+		stripes = filters_pool.stripes;
+		pthread_mutex_unlock(&filters_pool.mutex);
+		filters_stripe(f, fd, n, stripes);
+		pthread_mutex_lock(&filters_pool.mutex);
+		if (--filters_pool.busy == 0)
+			pthread_cond_signal(&filters_pool.done);
+	}
+	pthread_mutex_unlock(&filters_pool.mutex);
+	return NULL;
+}
+
+static void filters_threads_stop()
+{
+	unsigned int i;
+
+	if (filters_pool.stripes == 0)
+		return;
+	pthread_mutex_lock(&filters_pool.mutex);
+	filters_pool.quit = true;
+	pthread_cond_broadcast(&filters_pool.cond);
+	pthread_mutex_unlock(&filters_pool.mutex);
+	for (i = 1; (i != filters_pool.stripes); ++i)
+		pthread_join(filters_pool.thread[(i - 1)], NULL);
+	pthread_cond_destroy(&filters_pool.done);
+	pthread_cond_destroy(&filters_pool.cond);
+	pthread_mutex_destroy(&filters_pool.mutex);
+	filters_pool.stripes = 0;
+}
+
+/**
+ * Start or restart filter threads according to dgen_filter_threads.
+ * One thread doesn't need any worker.
+ */
+static void filters_threads_config()
+{
+	long stripes = dgen_filter_threads;
+
+	if (stripes <= 0)
+		stripes = sysconf(_SC_NPROCESSORS_ONLN);
+	if (stripes < 1)
+		stripes = 1;
+	else if (stripes > (long)(elemof(filters_pool.thread) + 1))
+		stripes = (elemof(filters_pool.thread) + 1);
+	if ((filters_pool.stripes == (unsigned int)stripes) ||
+	    ((filters_pool.stripes == 0) && (stripes == 1)))
+		return;
+	filters_threads_stop();
+	if (stripes == 1)
+		return;
+	if (pthread_mutex_init(&filters_pool.mutex, NULL))
+		goto error;
+	if (pthread_cond_init(&filters_pool.cond, NULL))
+		goto error_cond;
+	if (pthread_cond_init(&filters_pool.done, NULL))
+		goto error_done;
+	filters_pool.job = 0;
+	filters_pool.busy = 0;
+	filters_pool.quit = false;
+	for (filters_pool.stripes = 1;
+	     (filters_pool.stripes != (unsigned int)stripes);
+	     ++filters_pool.stripes)
+		if (pthread_create(&filters_pool.thread[(filters_pool.stripes -
+							 1)],
+				   NULL, filters_thread,
+				   (void *)(uintptr_t)filters_pool.stripes))
+			break;
+	if (filters_pool.stripes == (unsigned int)stripes)
+		return;
+	// Keep those that could be started.
+	DEBUG(("only %u filter thread(s) out of %ld",
+	       filters_pool.stripes, stripes));
+	if (filters_pool.stripes == 1)
+		goto error_threads;
+	dgen_filter_threads = filters_pool.stripes;
+	return;
+error_threads:
+	pthread_cond_destroy(&filters_pool.done);
+error_done:
+	pthread_cond_destroy(&filters_pool.cond);
+error_cond:
+	pthread_mutex_destroy(&filters_pool.mutex);
+error:
+	filters_pool.stripes = 0;
+	dgen_filter_threads = 1;
+}
+
+#endif // WITH_THREADS
+
+/**
+ * Run filter "f" from filters_stack_data[i] to filters_stack_data[i + 1].
+ * @param i Filters stack index.
+ */
+static void filters_run(size_t i)
+{
+	const struct filter *f = filters_stack[i];
+	struct filter_data *fd = &filters_stack_data[i];
+	struct filter_data in;
+
+#ifdef WITH_THREADS
+	// Filters must be initialized first and cannot be split if they read
+	// neighboring lines that are being overwritten.
+	if ((filters_pool.stripes > 1) && (fd[1].updated == true) &&
+	    ((f->rows == false) || (fd[0].buf.u8 != fd[1].buf.u8))) {
+		pthread_mutex_lock(&filters_pool.mutex);
+		filters_pool.f = f;
+		filters_pool.fd = fd;
+		filters_pool.busy = (filters_pool.stripes - 1);
+		++filters_pool.job;
+		pthread_cond_broadcast(&filters_pool.cond);
+		pthread_mutex_unlock(&filters_pool.mutex);
+		filters_stripe(f, fd, 0, filters_pool.stripes);
+		pthread_mutex_lock(&filters_pool.mutex);
+		while (filters_pool.busy)
+			pthread_cond_wait(&filters_pool.done,
+					  &filters_pool.mutex);
+		pthread_mutex_unlock(&filters_pool.mutex);
+		return;
+	}
+#endif
+	in = fd[0];
+	in.first = 0;
+	in.end = in.height;
+	f->func(&in, &fd[1]);
+}
+
 /**
  * Display screen.
  * @param update False if screen buffer is garbage and must be updated first.
@@ -1691,27 +2120,31 @@ void pd_graphics_update(bool update)
 	static unsigned long fps_since = 0;
 	static unsigned long frames_old = 0;
 	static unsigned long frames = 0;
-	const struct filter *f;
-	struct filter_data *fd;
 	size_t i;
 
 	++frames;
 
+	// The VDP has already drawn into the surface.
+	if (mdscr_direct) {
+		screen_update_lines();
+		return;
+	}
+#ifdef WITH_THREADS
+	filters_threads_config();
+#endif
 	// Process output through filters.
 	for (i = 0; (i != elemof(filters_stack)); ++i) 
 	{
-		f = filters_stack[i];
-		fd = &filters_stack_data[i];
 		if ((filters_stack_size == 0) ||
 		    (i == (filters_stack_size - 1)))
 			break;
-		f->func(fd, (fd + 1));
+		filters_run(i);
 	}
 	
 	// Lock screen.
 	screen_lock();
 	// Generate screen output with the last filter.
-	f->func(fd, (fd + 1));
+	filters_run(i);
 	// Unlock screen.
 	screen_unlock();
 	// Update the screen.
@@ -1791,22 +2224,21 @@ int pd_sound_init(long &freq, unsigned int &samples)
 	sound.samples = spec.samples;
 	samples += sound.samples;
 
-	// Calculate buffer size (sample size = (channels * (bits / 8))).
-	sound.cbuf.size = (samples * (2 * (16 / 8)));
-	sound.cbuf.i = 0;
-	sound.cbuf.s = 0;
-
-	fprintf(stderr, "sound: %uHz, %d samples, buffer: %u bytes\n",
-		sound.rate, spec.samples, (unsigned int)sound.cbuf.size);
-
 	// Allocate zero-filled play buffer.
 	sndi.lr = (int16_t *)calloc(2, (sndi.len * sizeof(sndi.lr[0])));
+	// dgen_sound_sync never resamples by more than 1%.
+	sound.sync_max = (sndi.len + (sndi.len / 100) + 1);
+	sound.sync_lr = (int16_t *)
+		calloc(2, (sound.sync_max * sizeof(sound.sync_lr[0])));
 
-	sound.cbuf.data.i16 = (int16_t *)calloc(1, sound.cbuf.size);
-	if ((sndi.lr == NULL) || (sound.cbuf.data.i16 == NULL)) {
+	// Calculate buffer size (sample size = (channels * (bits / 8))).
+	if ((sndi.lr == NULL) || (sound.sync_lr == NULL) ||
+	    (!cbuf_init(&sound.cbuf, (samples * (2 * (16 / 8)))))) {
 		fprintf(stderr, "sdl: couldn't allocate sound buffers.\n");
 		goto snd_error;
 	}
+	fprintf(stderr, "sound: %uHz, %d samples, buffer: %u bytes\n",
+		sound.rate, spec.samples, (unsigned int)sound.cbuf.max);
 
 	// Start sound output.
 	SDL_PauseAudio(0);
@@ -1822,6 +2254,7 @@ snd_error:
 	sndi.len = 0;
 	free((void *)sound.cbuf.data.i16);
 	sound.cbuf.data.i16 = NULL;
+	free((void *)sound.sync_lr);
 	memset(&sound, 0, sizeof(sound));
 	return 0;
 #else
@@ -1839,6 +2272,7 @@ void pd_sound_deinit()
 		SDL_CloseAudio();
 		free((void *)sound.cbuf.data.i16);
 	}
+	free((void *)sound.sync_lr);
 	memset(&sound, 0, sizeof(sound));
 	free((void*)sndi.lr);
 	sndi.lr = NULL;
@@ -1850,26 +2284,88 @@ void pd_sound_deinit()
  */
 unsigned int pd_sound_rp()
 {
-	unsigned int ret;
+	size_t ret;
 
 	if (!sound.cbuf.size)
 		return 0;
-	SDL_LockAudio();
-	ret = sound.cbuf.i;
-	SDL_UnlockAudio();
-	return (ret >> 2);
+	ret = __atomic_load_n(&sound.cbuf.tail, __ATOMIC_ACQUIRE);
+	return ((ret & (sound.cbuf.size - 1)) >> 2);
 }
 
 unsigned int pd_sound_wp()
 {
-	unsigned int ret;
-
 	if (!sound.cbuf.size)
 		return 0;
-	SDL_LockAudio();
-	ret = ((sound.cbuf.i + sound.cbuf.s) % sound.cbuf.size);
-	SDL_UnlockAudio();
-	return (ret >> 2);
+	return ((sound.cbuf.head & (sound.cbuf.size - 1)) >> 2);
+}
+
+/**
+ * Return sound buffer status.
+ * @param[out] st Status.
+ */
+void pd_sound_status(struct pd_sound_status *st)
+{
+	st->fill = (cbuf_fill(&sound.cbuf) >> 2);
+	st->size = (sound.cbuf.max >> 2);
+	st->overruns = sound.cbuf.overruns;
+	st->underruns = __atomic_load_n(&sound.cbuf.underruns,
+					__ATOMIC_RELAXED);
+}
+
+/// Maximum rate adjustment for dgen_sound_sync, 0.5% in 16.16 format.
+#define SOUND_SYNC_DELTA 328
+
+/**
+ * Write contents of sndi to sound.cbuf for dgen_sound_sync.
+ * The sound card is the master clock. Emulation waits while the buffer is
+ * more than 3/4 full, and sndi is resampled to slightly fewer samples when
+ * it's above half and to slightly more when it's below. This absorbs the
+ * difference between the sound card and whatever else paces frames (vsync
+ * on a display not exactly at video.hz) without underruns or overruns.
+ */
+static void sound_sync_write()
+{
+	int32_t max = (sound.cbuf.max >> 2);
+	int32_t fill = (cbuf_fill(&sound.cbuf) >> 2);
+	unsigned long wait = pd_usecs();
+	unsigned int len = sndi.len;
+	int32_t adj;
+	uint32_t out;
+	unsigned int out_len;
+	uint32_t step;
+	uint32_t pos;
+	unsigned int i;
+
+	// Don't wait more than two frames if the sound card is stuck.
+	while ((fill > ((max * 3) / 4)) &&
+	       ((pd_usecs() - wait) < (2000000 / video.hz))) {
+		SDL_Delay(1);
+		fill = (cbuf_fill(&sound.cbuf) >> 2);
+	}
+	adj = (((max - (fill * 2)) * SOUND_SYNC_DELTA) / max);
+	out = ((int32_t)(len << 16) + ((int32_t)len * adj) +
+	       (int32_t)sound.sync_frac);
+	out_len = (out >> 16);
+	sound.sync_frac = (out & 0xffff);
+	if (out_len > sound.sync_max)
+		out_len = sound.sync_max;
+	if ((out_len == 0) || (len == 0))
+		return;
+	// Linear interpolation, with 15 bits of precision to stay within
+	// 32-bit products.
+	step = ((len << 16) / out_len);
+	for (i = 0, pos = 0; (i != out_len); ++i, pos += step) {
+		unsigned int k = (pos >> 16);
+		int32_t frac = ((pos & 0xffff) >> 1);
+		const int16_t *a = &sndi.lr[(k << 1)];
+		const int16_t *b = (((k + 1) < len) ? (a + 2) : a);
+
+		sound.sync_lr[(i << 1)] =
+			(a[0] + (((b[0] - a[0]) * frac) >> 15));
+		sound.sync_lr[((i << 1) + 1)] =
+			(a[1] + (((b[1] - a[1]) * frac) >> 15));
+	}
+	cbuf_write(&sound.cbuf, (uint8_t *)sound.sync_lr, (out_len * 4));
 }
 
 /**
@@ -1879,9 +2375,11 @@ void pd_sound_write()
 {
 	if (!sound.cbuf.size)
 		return;
-	SDL_LockAudio();
+	if (dgen_sound_sync) {
+		sound_sync_write();
+		return;
+	}
 	cbuf_write(&sound.cbuf, (uint8_t *)sndi.lr, (sndi.len * 4));
-	SDL_UnlockAudio();
 }
 
 /**
@@ -3205,10 +3703,11 @@ void pd_quit()
 {
 	size_t i;
 
-	if (mdscr.data) {
+	if ((mdscr.data) && (!mdscr_direct)) {
 		free((void*)mdscr.data);
-		mdscr.data = NULL;
 	}
+	mdscr.data = NULL;
+	mdscr_direct = false;
 	SDL_QuitSubSystem(SDL_INIT_VIDEO);
 	
 	#ifndef NOSOUND
@@ -3227,5 +3726,8 @@ void pd_quit()
 		filters_stack_data[i + 1].data = NULL;
 	}
 	filters_stack_size = 0;
+#ifdef WITH_THREADS
+	filters_threads_stop();
+#endif
 	SDL_Quit();
 }
@@ -27,14 +27,20 @@ void md_vdp::reset()
 	memset(reg, 0, 0x20);
 	memset(dirt, 0xff, 0x35); // mark everything as changed
 	memset(highpal, 0, sizeof(highpal));
+	highpal_bpp = 0;
 	memset(sprite_order, 0, sizeof(sprite_order));
-	memset(sprite_mask, 0xff, sizeof(sprite_mask));
+	sprite_spans_count = 0;
+	sprite_spans_line = -1;
 	sprite_base = NULL;
 	sprite_count = 0;
+	memset(sprite_lines_start, 0, sizeof(sprite_lines_start));
+	sprite_frame_end[0] = sprite_frame_end[1] = 0;
+	sprite_reg12 = 0;
 	masking_sprite_index_cache = -1;
 	dots_cache = 0;
 	sprite_overflow_line = INT_MIN;
-	dest = NULL;
+	memset(line_buf, 0, sizeof(line_buf));
+	dest = (line_buf + 8);
 	bmap = NULL;
 }
 
@@ -50,7 +56,9 @@ md_vdp::md_vdp(md& md): belongs(md)
 	vsram = (mem + 0x10080);
 	dirt = (mem + 0x10100); // VRAM/CRAM/Reg dirty buffer bitfield
 	// Also in 0x34 are global dirt flags (inclduing VSRAM this time)
-	Bpp = Bpp_times8 = 0;
+	status = &md.coo5;
+	Bpp = 0;
+	convert = NULL;
 	reset();
 }
 
@@ -89,6 +97,247 @@ unsigned char md_vdp::dma_mem_read(int addr)
   return belongs.misc_readbyte(addr);
 }
 
+/**
+ * 68K to VDP DMA (modes 0 and 1).
+ * Source words are taken directly from ROM and RAM pages of the misc_*()
+ * page table. VRAM writes with an even address and increment are copied
+ * in runs that stay within a 256 byte block so that dirt is updated once
+ * per block. Everything else goes through dma_mem_read() and putword().
+ *
+ * @param src Source address.
+ * @param len Number of words to transfer.
+ */
+void md_vdp::dma_mem_copy(int src, int len)
+{
+  while (len > 0)
+  {
+    const struct md::bus_page *page;
+    const uint8_t *r;
+    unsigned int swab;
+    int n;
+
+    src &= 0x00ffffff;
+    page = &belongs.bus_map[(src >> 16)];
+    // Words left in this source page.
+    n = ((0x10000 - (src & 0xffff)) >> 1);
+    if (n > len)
+      n = len;
+    if ((page->r == NULL) || (src & 1))
+    {
+      // I/O, save RAM and partial ROM pages.
+      unsigned short val;
+
+      val= dma_mem_read(src++); val<<=8;
+      val|=dma_mem_read(src++); putword(val);
+      --len;
+      continue;
+    }
+    r = &page->r[(src & 0xffff)];
+    swab = page->swab;
+    src += (n << 1);
+    len -= n;
+    if ((rw_mode != 0x04) || (rw_addr & 1) || (reg[15] & 1))
+    {
+      // CRAM, VSRAM, odd VRAM addresses and increments.
+      for (; (n != 0); --n, r += 2)
+        putword((r[swab] << 8) | r[(swab ^ 1)]);
+      continue;
+    }
+    while (n != 0)
+    {
+      unsigned int inc = reg[15];
+      unsigned int addr = (rw_addr & 0xffff);
+      unsigned int diff = 0;
+      int run = n;
+
+      // Words until the next 256 byte block.
+      if (inc != 0)
+      {
+        int left = (((0x100 - (addr & 0xff)) + inc - 1) / inc);
+
+        if (run > left)
+          run = left;
+      }
+      n -= run;
+      rw_addr += (run * inc);
+      for (; (run != 0); --run, r += 2, addr += inc)
+      {
+        uint8_t hi = r[swab];
+        uint8_t lo = r[(swab ^ 1)];
+
+        addr &= 0xffff;
+        diff |= ((vram[addr] ^ hi) | (vram[(addr + 1)] ^ lo));
+        vram[addr] = hi;
+        vram[(addr + 1)] = lo;
+      }
+      if (diff)
+      {
+        addr = ((addr - inc) & 0xffff);
+        dirt[((addr >> 11) & 0x1f)] |= (1 << ((addr >> 8) & 7));
+        dirt[0x34] |= 1;
+      }
+    }
+  }
+}
+
+#ifdef __GNUC__
+typedef uint32_t __attribute__((__may_alias__)) vram32_t;
+#else
+typedef uint32_t vram32_t;
+#endif
+
+/**
+ * Fill VRAM with a repeating pattern, even addresses get "hi" and odd ones
+ * "lo". Dirt is only updated for 256 byte blocks that actually change.
+ *
+ * @param addr First address, wraps around at 0xffff.
+ * @param len Number of bytes (at most 0x10000).
+ * @param hi Byte to store at even addresses.
+ * @param lo Byte to store at odd addresses.
+ */
+void md_vdp::vram_fill(unsigned int addr, unsigned int len,
+		       uint8_t hi, uint8_t lo)
+{
+  uint8_t pat[5] = { hi, lo, hi, lo, hi };
+
+  while (len)
+  {
+    unsigned int n;
+    uint8_t *p;
+    uint8_t *end;
+    vram32_t v;
+    unsigned int diff = 0;
+
+    addr &= 0xffff;
+    n = (0x100 - (addr & 0xff));
+    if (n > len)
+      n = len;
+    p = &vram[addr];
+    end = (p + n);
+    // Head, until p is 32-bit aligned.
+    for (; ((p != end) && ((uintptr_t)p & 3)); ++p)
+    {
+      uint8_t b = pat[((p - vram) & 1)];
+
+      diff |= (*p ^ b);
+      *p = b;
+    }
+    memcpy(&v, &pat[((p - vram) & 1)], sizeof(v));
+    for (; ((end - p) >= 4); p += 4)
+    {
+      diff |= (*(vram32_t *)p ^ v);
+      *(vram32_t *)p = v;
+    }
+    for (; (p != end); ++p)
+    {
+      uint8_t b = pat[((p - vram) & 1)];
+
+      diff |= (*p ^ b);
+      *p = b;
+    }
+    if (diff)
+    {
+      dirt[((addr >> 11) & 0x1f)] |= (1 << ((addr >> 8) & 7));
+      dirt[0x34] |= 1;
+    }
+    addr += n;
+    len -= n;
+  }
+}
+
+/**
+ * VRAM fill DMA (mode 2), started by a data port write.
+ * VRAM with an increment of 1 or 2 is filled in blocks, the result is the
+ * same as calling putword() or putbyte() "len" times.
+ *
+ * @param hi High byte written to the data port.
+ * @param lo Low byte written to the data port.
+ * @param len Number of writes.
+ * @param word True for a word write, false for a byte write (lo only).
+ */
+void md_vdp::dma_vram_fill(uint8_t hi, uint8_t lo, int len, bool word)
+{
+  unsigned int inc = reg[15];
+  unsigned int n;
+
+  if ((len <= 0) || (rw_mode != 0x04) || (inc == 0) || (inc > 2) ||
+      ((!word) && (inc == 2)))
+  {
+    int i;
+
+    for (i=0;i<len;i++)
+      if (word)
+        putword((hi << 8) | lo);
+      else
+        putbyte(lo);
+    return;
+  }
+  // Byte writes only cover "len" bytes. With word writes, each one
+  // overlaps the next by a byte when the increment is 1, the last one
+  // spills over. Either way even addresses always end up with the high
+  // byte and odd ones with the low byte.
+  if (!word)
+    n = len;
+  else if (inc == 1)
+    n = (len + 1);
+  else
+    n = (len * 2);
+  if (n > 0x10000)
+    n = 0x10000;
+  if (!word)
+    hi = lo;
+  vram_fill(rw_addr, n, hi, lo);
+  rw_addr += (inc * len);
+}
+
+/**
+ * VRAM copy DMA (mode 3).
+ * Non-overlapping copies to even addresses with an increment of 2 are done
+ * with memcpy() per 256 byte block, everything else is copied word by word
+ * through putword() like the hardware would.
+ *
+ * @param src Source address in VRAM.
+ * @param len Number of words to copy.
+ */
+void md_vdp::dma_vram_copy(int src, int len)
+{
+  unsigned int s = (src & 0xffff);
+  unsigned int d = (rw_addr & 0xffff);
+  unsigned int n = (len * 2);
+  int i;
+
+  if ((len > 0) && (rw_mode == 0x04) && (reg[15] == 2) &&
+      (((s | d) & 1) == 0) &&
+      ((s + n) <= 0x10000) && ((d + n) <= 0x10000) &&
+      (((s + n) <= d) || ((d + n) <= s)))
+  {
+    rw_addr += (2 * len);
+    while (n)
+    {
+      unsigned int run = (0x100 - (d & 0xff));
+
+      if (run > n)
+        run = n;
+      if (memcmp(&vram[d], &vram[s], run))
+      {
+        memcpy(&vram[d], &vram[s], run);
+        dirt[((d >> 11) & 0x1f)] |= (1 << ((d >> 8) & 7));
+        dirt[0x34] |= 1;
+      }
+      s += run;
+      d += run;
+      n -= run;
+    }
+    return;
+  }
+  for (i=0;i<len;i++)
+  {
+    unsigned short val;
+    val= vram[(src++)&0xffff]; val<<=8;
+    val|=vram[(src++)&0xffff]; putword(val);
+  }
+}
+
 /**
  * Set value in VRAM.
  * Must go through these calls to update the dirty flags.
@@ -316,29 +565,19 @@ int md_vdp::command(uint16_t cmd)
   if (rw_dma)
   {
     int mode=(reg[0x17]>>6)&3;
-    int s=0,d=0,i=0,len=0;
+    int s=0,d=0,len=0;
     s=dma_addr(); d=rw_addr; len=dma_len();
     (void)d;
     switch (mode)
     {
       case 0: case 1:
-        for (i=0;i<len;i++)
-        {
-          unsigned short val;
-          val= dma_mem_read(s++); val<<=8;
-          val|=dma_mem_read(s++); putword(val);
-        }
+        dma_mem_copy(s, len);
       break;
       case 2:
         // Done later on (VRAM fill I believe)
       break;
       case 3:
-        for (i=0;i<len;i++)
-        {
-          unsigned short val;
-          val= vram[(s++)&0xffff]; val<<=8;
-          val|=vram[(s++)&0xffff]; putword(val);
-        }
+        dma_vram_copy(s, len);
       break;
     }
   }
@@ -360,10 +599,7 @@ int md_vdp::writeword(unsigned short d)
     // Do a dma fill if it's set up:
     if (((reg[0x17]>>6)&3)==2)
     {
-      int i,len;
-      len=dma_len();
-      for (i=0;i<len;i++)
-        putword(d);
+      dma_vram_fill((d >> 8), (d & 0xff), dma_len(), true);
       return 0;
     }
   }
@@ -389,10 +625,7 @@ int md_vdp::writebyte(unsigned char d)
     // Do a dma fill if it's set up:
     if (((reg[0x17]>>6)&3)==2)
     {
-      int i,len;
-      len=dma_len();
-      for (i=0;i<len;i++)
-        putbyte(d);
+      dma_vram_fill(d, d, dma_len(), false);
       return 0;
     }
   }
@@ -428,3 +661,148 @@ void md_vdp::write_reg(uint8_t addr, uint8_t data)
 	// "Writing to a VDP register will clear the code register."
 	rw_mode = 0;
 }
+
+#ifdef WITH_THREADS
+
+// snap_line() record header. It is followed by the registers, CRAM and
+// VSRAM when their flags are set, then by "blocks" VRAM blocks, each one a
+// block number and its 256 bytes.
+struct vdp_snap_line {
+	uint16_t line;
+	uint16_t blocks;
+	uint8_t flags;
+};
+
+#define VDP_SNAP_REG 0x01
+#define VDP_SNAP_CRAM 0x02
+#define VDP_SNAP_VSRAM 0x04
+
+/**
+ * Record what changed since the previous call for scanline "line".
+ * VRAM, CRAM and VSRAM dirt is consumed, so this VDP must not be used to
+ * draw anything while it's being recorded.
+ *
+ * @param snap Buffer to append the record to.
+ * @param line Scanline number.
+ * @return 0 on success, -1 if out of memory.
+ */
+int md_vdp::snap_line(struct vdp_snap *snap, int line)
+{
+	struct vdp_snap_line head;
+	size_t len = sizeof(head);
+	unsigned int i;
+	uint8_t *p;
+
+	head.line = line;
+	head.blocks = 0;
+	head.flags = 0;
+	if (memcmp(snap_reg, reg, sizeof(snap_reg))) {
+		head.flags |= VDP_SNAP_REG;
+		len += sizeof(snap_reg);
+	}
+	if (dirt[0x34] & 2) {
+		head.flags |= VDP_SNAP_CRAM;
+		len += 0x80;
+	}
+	if (dirt[0x34] & 4) {
+		head.flags |= VDP_SNAP_VSRAM;
+		len += 0x80;
+	}
+	for (i = 0; (i != 0x20); ++i) {
+		unsigned int bits;
+
+		for (bits = dirt[i]; (bits); bits >>= 1)
+			head.blocks += (bits & 1);
+	}
+	len += (head.blocks * (1 + 0x100));
+	if ((snap->len + len) > snap->size) {
+		size_t size = ((snap->len + len) * 2);
+
+		if ((p = (uint8_t *)realloc(snap->data, size)) == NULL)
+			return -1;
+		snap->data = p;
+		snap->size = size;
+	}
+	p = (snap->data + snap->len);
+	memcpy(p, &head, sizeof(head));
+	p += sizeof(head);
+	if (head.flags & VDP_SNAP_REG) {
+		memcpy(snap_reg, reg, sizeof(snap_reg));
+		memcpy(p, reg, sizeof(snap_reg));
+		p += sizeof(snap_reg);
+	}
+	if (head.flags & VDP_SNAP_CRAM) {
+		memcpy(p, cram, 0x80);
+		p += 0x80;
+	}
+	if (head.flags & VDP_SNAP_VSRAM) {
+		memcpy(p, vsram, 0x80);
+		p += 0x80;
+	}
+	for (i = 0; (i != 0x20); ++i) {
+		unsigned int bits;
+		unsigned int block;
+
+		for (bits = dirt[i], block = (i << 3); (bits);
+		     bits >>= 1, ++block) {
+			if (!(bits & 1))
+				continue;
+			*(p++) = block;
+			memcpy(p, (vram + (block << 8)), 0x100);
+			p += 0x100;
+		}
+		dirt[i] = 0;
+	}
+	memset(&dirt[0x20], 0, 0x10);
+	dirt[0x34] &= ~(2 | 4);
+	snap->len = (p - snap->data);
+	return 0;
+}
+
+/**
+ * Apply a record from snap_line(), dirt is updated as if the changes had
+ * been written through the usual ports.
+ *
+ * @param[in,out] data Record to apply, updated to point to the next one.
+ * @return Scanline number of the record.
+ */
+int md_vdp::snap_apply(const uint8_t **data)
+{
+	struct vdp_snap_line head;
+	const uint8_t *p = *data;
+	unsigned int i;
+
+	memcpy(&head, p, sizeof(head));
+	p += sizeof(head);
+	if (head.flags & VDP_SNAP_REG) {
+		for (i = 0; (i != sizeof(snap_reg)); ++i)
+			write_reg(i, p[i]);
+		p += sizeof(snap_reg);
+	}
+	if (head.flags & VDP_SNAP_CRAM) {
+		for (i = 0; (i != 0x80); ++i)
+			if (cram[i] != p[i]) {
+				dirt[(0x20 + (i >> 3))] |= (1 << (i & 7));
+				cram[i] = p[i];
+			}
+		dirt[0x34] |= 2;
+		p += 0x80;
+	}
+	if (head.flags & VDP_SNAP_VSRAM) {
+		memcpy(vsram, p, 0x80);
+		dirt[0x34] |= 4;
+		p += 0x80;
+	}
+	for (i = 0; (i != head.blocks); ++i) {
+		unsigned int block = *(p++);
+
+		memcpy((vram + (block << 8)), p, 0x100);
+		dirt[(block >> 3)] |= (1 << (block & 7));
+		dirt[0x34] |= 1;
+		p += 0x100;
+	}
+	*data = p;
+	return head.line;
+}
+
+#endif